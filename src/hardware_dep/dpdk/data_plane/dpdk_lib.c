@@ -78,6 +78,9 @@ uint8_t get_port_n_rx_queues(uint8_t port)
 #include "dpdk_lib_init_hw.c"
 #include "dpdk_lib_parse_args.c"
 #include "dpdk_lib_print.c"
+#include "dpdk_lib_rebalance.c"
+#include "dpdk_lib_stats.c"
+#include "dpdk_lib_profile.c"
 
 //=============================================================================
 // Calculations
@@ -95,3 +98,142 @@ uint32_t packet_length(packet_descriptor_t* pd) {
 packet* clone_packet(packet* pd, struct rte_mempool* mempool) {
     return rte_pktmbuf_clone(pd, mempool);
 }
+
+//=============================================================================
+// Multi-segment packets
+
+// Copies the next header of the packet (at parsed_length) into the bounce storage.
+// After the first such header, all later ones are bounced as well,
+// so the bounced headers are contiguous both in the storage and in the packet.
+// Returns NULL if the packet is too short for the header or the storage is full;
+// then the parser rejects the packet.
+uint8_t* parser_bounce_header(packet_descriptor_t* pd, uint32_t length)
+{
+    uint32_t offset = pd->parsed_length;
+    if (unlikely(offset + length > rte_pktmbuf_pkt_len(pd->wrapper))) {
+        debug("   " T4LIT(!!,warning) " Packet is too short for " T4LIT(%d) " bytes of headers at offset " T4LIT(%d) "\n", length, offset);
+        return NULL;
+    }
+
+    if (pd->bounce_length == 0)    pd->bounce_offset = offset;
+
+    if (unlikely(pd->bounce_length + length > sizeof(pd->header_bounce_storage))) {
+        debug("   " T4LIT(!!,error) " No room to copy a header of " T4LIT(%d) " bytes at offset " T4LIT(%d) "\n", length, offset);
+        return NULL;
+    }
+
+    uint8_t* dst = pd->header_bounce_storage + pd->bounce_length;
+    const uint8_t* src = rte_pktmbuf_read(pd->wrapper, offset, length, dst);
+    if (src != dst)    memcpy(dst, src, length);
+
+    pd->bounce_length += length;
+    pd->parse_end = dst + length;
+    return dst;
+}
+
+void write_back_bounced_headers(packet_descriptor_t* pd)
+{
+    uint32_t pkt_len = rte_pktmbuf_pkt_len(pd->wrapper);
+    if (pd->bounce_length == 0 || (uint32_t)pd->bounce_offset >= pkt_len)    return;
+
+    uint32_t length = RTE_MIN((uint32_t)pd->bounce_length, pkt_len - pd->bounce_offset);
+    write_packet_bytes(pd->wrapper, pd->bounce_offset, pd->header_bounce_storage, length);
+}
+
+// The old headers are cut off the packet, and a new segment with room for the new headers is chained in front of it.
+// If the ports cannot send chained mbufs, the packet is linearized into the new segment.
+// Returns the data of the new first segment, or NULL if the packet could not be changed.
+uint8_t* prepend_header_segment(packet_descriptor_t* pd, uint32_t old_headers_length, uint32_t new_headers_length)
+{
+    struct rte_mbuf* pkt = pd->wrapper;
+
+    if (unlikely(old_headers_length > rte_pktmbuf_data_len(pkt)))    return NULL;
+
+    struct rte_mbuf* hdr = rte_pktmbuf_alloc(pkt->pool);
+    if (unlikely(hdr == NULL))    return NULL;
+
+    uint8_t* data = (uint8_t*)rte_pktmbuf_append(hdr, new_headers_length);
+    if (unlikely(data == NULL)) {
+        rte_pktmbuf_free(hdr);
+        return NULL;
+    }
+
+    hdr->port       = pkt->port;
+    hdr->vlan_tci   = pkt->vlan_tci;
+    hdr->vlan_tci_outer = pkt->vlan_tci_outer;
+    hdr->tx_offload = pkt->tx_offload;
+    hdr->hash       = pkt->hash;
+    hdr->ol_flags   = pkt->ol_flags;
+    hdr->packet_type = pkt->packet_type;
+#ifdef T4P4S_LATENCY
+    MBUF_RX_TSC(hdr) = MBUF_RX_TSC(pkt);
+#endif
+
+    rte_pktmbuf_adj(pkt, old_headers_length);
+    if (rte_pktmbuf_data_len(pkt) == 0) {
+        // the packet has no payload in its first segment
+        struct rte_mbuf* rest = pkt->next;
+        pkt->next    = NULL;
+        pkt->nb_segs = 1;
+        rte_pktmbuf_free(pkt);
+        pkt = rest;
+    }
+
+    if (pkt != NULL) {
+        hdr->next     = pkt;
+        hdr->nb_segs += pkt->nb_segs;
+        hdr->pkt_len += pkt->pkt_len;
+    }
+
+    pd->wrapper = hdr;
+
+#ifdef T4P4S_STATS
+    ++lcore_conf[rte_lcore_id()].hw.stats.header_segs;
+#endif
+
+    if (!multi_seg_tx_offload && hdr->nb_segs > 1) {
+        // on failure, the packet is dropped along with its new segment
+        if (unlikely(rte_pktmbuf_linearize(hdr) != 0))    return NULL;
+    }
+
+    return data;
+}
+
+void write_packet_bytes_segmented(packet* pkt, uint32_t offset, const uint8_t* src, uint32_t length)
+{
+    struct rte_mbuf* seg = pkt;
+    while (seg != NULL && offset >= rte_pktmbuf_data_len(seg)) {
+        offset -= rte_pktmbuf_data_len(seg);
+        seg = seg->next;
+    }
+
+    while (seg != NULL && length > 0) {
+        uint32_t seg_length = RTE_MIN(length, rte_pktmbuf_data_len(seg) - offset);
+        memcpy(rte_pktmbuf_mtod_offset(seg, uint8_t*, offset), src, seg_length);
+        src    += seg_length;
+        length -= seg_length;
+        offset  = 0;
+        seg     = seg->next;
+    }
+}
+
+//=============================================================================
+// Multicast
+
+uint32_t mcast_group_ports[T4P4S_MCAST_GROUP_COUNT];
+
+// Called by the control plane thread; the lcores read the group
+// with a single aligned load, so they see either the old or the new ports.
+void set_mcast_group(uint16_t mcast_grp, uint32_t port_mask) {
+    if (unlikely(mcast_grp == 0 || mcast_grp >= T4P4S_MCAST_GROUP_COUNT)) {
+        debug(" " T4LIT(!!!!,error) " Multicast group " T4LIT(%d) " is out of range (1.." T4LIT(%d) "), ignored\n", mcast_grp, T4P4S_MCAST_GROUP_COUNT - 1);
+        return;
+    }
+
+    if (unlikely((port_mask & ~enabled_port_mask) != 0)) {
+        debug(" " T4LIT(!!!!,warning) " Multicast group " T4LIT(%d) ": disabled ports " T4LIT(0x%x) " are left out\n", mcast_grp, port_mask & ~enabled_port_mask);
+    }
+
+    mcast_group_ports[mcast_grp] = port_mask & enabled_port_mask;
+    debug(" :::: Multicast group " T4LIT(%d) " is set to ports " T4LIT(0x%x) "\n", mcast_grp, mcast_group_ports[mcast_grp]);
+}
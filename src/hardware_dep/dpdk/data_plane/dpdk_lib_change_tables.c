@@ -78,6 +78,9 @@ void lpm_add_promote(int tableid, uint8_t* key, uint8_t depth, uint8_t* value) {
 void ternary_add_promote(int tableid, uint8_t* key, uint8_t* mask, uint8_t* value) {
     FORALLNUMANODES(Add, "/" T4LIT(ternary), CHANGE_TABLE(ternary_add, key, mask, value))
 }
+void exact_add_part_promote(int tableid, uint8_t* key, int offset, uint8_t* value, int size) {
+    FORALLNUMANODES(Add, "/" T4LIT(fused), CHANGE_TABLE(exact_add_part, key, offset, value, size))
+}
 void table_setdefault_promote(int tableid, uint8_t* value) {
     FORALLNUMANODES_NOKEY(Set default, "on table", CHANGE_TABLE(table_set_default_action, value))
 }
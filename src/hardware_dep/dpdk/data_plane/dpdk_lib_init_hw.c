@@ -28,6 +28,8 @@ uint32_t enabled_port_mask;
 
 // NUMA is enabled by default.
 int numa_on = 1;
+// If set, an lcore cannot poll a port on another socket; otherwise, it is only a warning.
+bool numa_strict = false;
 
 
 uint16_t            nb_lcore_params;
@@ -40,8 +42,15 @@ struct rte_mempool* pktmbuf_pool[NB_SOCKETS];
 
 rte_eth_addr_t ports_eth_addr[RTE_MAX_ETHPORT_COUNT];
 
+// requested by --rxd/--txd, and adjusted to the limits of each port
 uint16_t t4p4s_nb_rxd = RTE_TEST_RX_DESC_DEFAULT;
 uint16_t t4p4s_nb_txd = RTE_TEST_TX_DESC_DEFAULT;
+uint16_t port_nb_rxd[RTE_MAX_ETHPORTS];
+uint16_t port_nb_txd[RTE_MAX_ETHPORTS];
+
+// the mbufs per socket (0 if calculated from the layout) and the per-lcore mempool cache size, see --mbufs and --mbuf-cache
+unsigned t4p4s_nb_mbuf         = 0;
+unsigned t4p4s_mbuf_cache_size = MEMPOOL_CACHE_SIZE;
 
 
 struct rte_eth_conf port_conf = {
@@ -75,6 +84,11 @@ struct rte_eth_conf port_conf = {
     },
 };
 
+// Set if all enabled ports calculate the IPv4 header checksum on TX.
+bool ipv4_cksum_tx_offload = false;
+// Set if all enabled ports can send chained mbufs; multicast replicas need this.
+bool multi_seg_tx_offload = false;
+
 //=============================================================================
 
 int check_lcore_params()
@@ -98,6 +112,16 @@ int check_lcore_params()
         if (socketid != 0 && numa_on == 0) {
             debug("warning: lcore %hhu is on socket %d with numa off \n", lcore, socketid);
         }
+
+        // the packets of the port would cross the sockets both on DMA and on processing
+        uint8_t portid = lcore_params[i].port_id;
+        int port_socketid = rte_eth_dev_socket_id(portid);
+        if (numa_on && port_socketid >= 0 && port_socketid != socketid) {
+            RTE_LOG(WARNING, P4_FWD, "port %hhu (socket %d) is polled by lcore %hhu on another socket (%d)\n",
+                    portid, port_socketid, lcore, socketid);
+            if (numa_strict)
+                return -1;
+        }
     }
     return 0;
 }
@@ -145,23 +169,74 @@ int init_lcore_rx_queues()
     return 0;
 }
 
-void init_mbuf_pool(int socketid)
+void adjust_nb_desc(uint8_t portid)
+{
+    port_nb_rxd[portid] = t4p4s_nb_rxd;
+    port_nb_txd[portid] = t4p4s_nb_txd;
+#if RTE_VERSION >= RTE_VERSION_NUM(17,11,0,0)
+    if (rte_eth_dev_adjust_nb_rx_tx_desc(portid, &port_nb_rxd[portid], &port_nb_txd[portid]) < 0)
+        rte_exit(EXIT_FAILURE, "Cannot adjust the number of descriptors of port %d\n", portid);
+#endif
+}
+
+// The most mbufs that the lcores of the socket can hold at the same time:
+// the RX rings of their queues, their TX rings and TX buffers,
+// and the mempool caches. The packets waiting in the TX backlogs are not counted;
+// if the NIC stalls for long, RX runs out of mbufs instead of the backlogs growing.
+unsigned calculate_nb_mbuf(int socketid, uint8_t nb_ports)
+{
+    unsigned nb_mbuf = 0;
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rte_lcore_is_enabled(lcore_id) == 0)   continue;
+        if (get_socketid(lcore_id) != socketid)    continue;
+
+        struct lcore_hardware_conf* hw = &lcore_conf[lcore_id].hw;
+        for (unsigned i = 0; i < hw->n_rx_queue; i++) {
+            nb_mbuf += port_nb_rxd[hw->rx_queue_list[i].port_id];
+        }
+
+        // the descriptors hold one segment each, the TX buffers hold whole packets
+        for (uint8_t portid = 0; portid < nb_ports; portid++) {
+            if (is_port_disabled(portid))    continue;
+            nb_mbuf += port_nb_txd[portid] + MBUF_TABLE_SIZE * MAX_SEGS_PER_PKT;
+        }
+
+        // the RX burst under processing, and the cache of the lcore
+        nb_mbuf += MBUF_TABLE_SIZE * MAX_SEGS_PER_PKT + t4p4s_mbuf_cache_size;
+    }
+
+    // not rounded up to 2^n-1, which could almost double the pool
+    return nb_mbuf;
+}
+
+void init_mbuf_pool(int socketid, uint8_t nb_ports)
 {
     if (pktmbuf_pool[socketid] != NULL) return;
 
-    debug(" :::: Allocating DPDK mbuf pool on socket " T4LIT(%d,socket) "\n", socketid);
+    unsigned nb_mbuf = t4p4s_nb_mbuf != 0 ? t4p4s_nb_mbuf : calculate_nb_mbuf(socketid, nb_ports);
+    // the cache can hold at most 2/3 of the pool
+    unsigned cache_size = RTE_MIN(t4p4s_mbuf_cache_size, RTE_MIN(RTE_MEMPOOL_CACHE_MAX_SIZE, nb_mbuf * 2 / 3));
+
+    debug(" :::: Allocating DPDK mbuf pool on socket " T4LIT(%d,socket) " with " T4LIT(%u) " mbufs\n", socketid, nb_mbuf);
 
     char s[64];
     snprintf(s, sizeof(s), "mbuf_pool_%d", socketid);
-    pktmbuf_pool[socketid] =
-        rte_mempool_create(s, NB_MBUF, MBUF_SIZE, MEMPOOL_CACHE_SIZE,
-            sizeof(struct rte_pktmbuf_pool_private),
-            rte_pktmbuf_pool_init, NULL,
-            rte_pktmbuf_init, NULL,
-            socketid, 0);
+    pktmbuf_pool[socketid] = rte_pktmbuf_pool_create(s, nb_mbuf, cache_size, 0, MBUF_DATA_SIZE, socketid);
 
     if (pktmbuf_pool[socketid] == NULL)
-        rte_exit(EXIT_FAILURE, "Cannot init mbuf pool on socket %d\n", socketid);
+        rte_exit(EXIT_FAILURE, "Cannot init mbuf pool of %u mbufs on socket %d\n", nb_mbuf, socketid);
+}
+
+void print_mbuf_pools()
+{
+    for (int socketid = 0; socketid < NB_SOCKETS; ++socketid) {
+        struct rte_mempool* mp = pktmbuf_pool[socketid];
+        if (mp == NULL)    continue;
+
+        uint64_t bytes = (uint64_t)mp->size * (mp->header_size + mp->elt_size + mp->trailer_size);
+        RTE_LOG(INFO, P4_FWD, "mbuf pool on socket %d: %u mbufs of %u bytes, cache %u per lcore, %" PRIu64 " KiB in total\n",
+                socketid, mp->size, mp->elt_size, mp->cache_size, bytes / 1024);
+    }
 }
 
 uint32_t max(uint32_t val1, uint32_t val2) {
@@ -185,8 +260,12 @@ bool init_tx_on_lcore(unsigned lcore_id, uint8_t portid, uint16_t queueid)
     struct rte_eth_dev_info dev_info;
     rte_eth_dev_info_get(portid, &dev_info);
     struct rte_eth_txconf* txconf = &dev_info.default_txconf;
+#if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0) && RTE_VERSION < RTE_VERSION_NUM(18,11,0,0)
+    // the queues get the offloads of the port instead of the deprecated txq_flags
+    txconf->txq_flags = ETH_TXQ_FLAGS_IGNORE;
+#endif
 
-    int ret = rte_eth_tx_queue_setup(portid, queueid, t4p4s_nb_txd, socketid, txconf);
+    int ret = rte_eth_tx_queue_setup(portid, queueid, port_nb_txd[portid], socketid, txconf);
     if (ret < 0)
         rte_exit(EXIT_FAILURE, "rte_eth_tx_queue_setup: err=%d, "
                  "port=%d\n", ret, portid);
@@ -196,6 +275,69 @@ bool init_tx_on_lcore(unsigned lcore_id, uint8_t portid, uint16_t queueid)
     return true;
 }
 
+// Requests the checksum and multi-segment offloads that the port supports.
+// The generated code falls back to software checksums for the rest,
+// and multicast falls back to full clones without multi-segment TX.
+void negotiate_offloads(uint8_t portid, struct rte_eth_conf* conf)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
+    struct rte_eth_dev_info dev_info;
+    rte_eth_dev_info_get(portid, &dev_info);
+
+    conf->rxmode.offloads &= dev_info.rx_offload_capa;
+    conf->txmode.offloads |= dev_info.tx_offload_capa & (DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_UDP_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM | DEV_TX_OFFLOAD_MULTI_SEGS);
+
+    ipv4_cksum_tx_offload &= (conf->txmode.offloads & DEV_TX_OFFLOAD_IPV4_CKSUM) != 0;
+    multi_seg_tx_offload  &= (conf->txmode.offloads & DEV_TX_OFFLOAD_MULTI_SEGS) != 0;
+
+    debug("   :: Checksum offloads on port " T4LIT(%d,port) ": RX IPv4 %s, RX L4 %s, TX IPv4 %s, TX L4 %s\n", portid,
+          conf->rxmode.offloads & DEV_RX_OFFLOAD_IPV4_CKSUM ? T4LIT(on,success) : T4LIT(off,warning),
+          conf->rxmode.offloads & (DEV_RX_OFFLOAD_UDP_CKSUM | DEV_RX_OFFLOAD_TCP_CKSUM) ? T4LIT(on,success) : T4LIT(off,warning),
+          conf->txmode.offloads & DEV_TX_OFFLOAD_IPV4_CKSUM ? T4LIT(on,success) : T4LIT(off,warning),
+          conf->txmode.offloads & (DEV_TX_OFFLOAD_UDP_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM) ? T4LIT(on,success) : T4LIT(off,warning));
+    debug("   :: Multi-segment TX on port " T4LIT(%d,port) ": %s\n", portid,
+          conf->txmode.offloads & DEV_TX_OFFLOAD_MULTI_SEGS ? T4LIT(on,success) : T4LIT(off,warning));
+#ifdef T4P4S_JUMBO
+    if ((conf->rxmode.offloads & DEV_RX_OFFLOAD_SCATTER) == 0 || (conf->txmode.offloads & DEV_TX_OFFLOAD_MULTI_SEGS) == 0) {
+        RTE_LOG(WARNING, P4_FWD, "Port %u cannot receive or send multi-segment packets, jumbo frames will be dropped\n", portid);
+    }
+#endif
+#else
+    // before DPDK 18.05, TX offloads depend on the txq_flags of the queues; checksums are calculated in software
+    // and multicast replicas are full clones
+    ipv4_cksum_tx_offload = false;
+    multi_seg_tx_offload  = false;
+#endif
+}
+
+#ifdef T4P4S_PTYPE
+// The parser can skip some of its selects using the packet types that the NIC fills in.
+// If the NIC does not classify the packets, the parser does all selects itself.
+void request_ptypes(uint8_t portid)
+{
+    uint32_t ptype_mask = RTE_PTYPE_L2_MASK | RTE_PTYPE_L3_MASK | RTE_PTYPE_L4_MASK;
+    int nb_ptypes = rte_eth_dev_get_supported_ptypes(portid, ptype_mask, NULL, 0);
+    if (nb_ptypes <= 0) {
+        RTE_LOG(INFO, P4_FWD, "Port %u does not classify packets, the parser will not use packet types\n", portid);
+        return;
+    }
+
+#if RTE_VERSION >= RTE_VERSION_NUM(19,11,0,0)
+    // only the ones that the parser uses
+    int ret = rte_eth_dev_set_ptypes(portid, ptype_mask, NULL, 0);
+    if (ret < 0) {
+        debug("   :: Port " T4LIT(%d,port) " cannot restrict its packet types (err=%d)\n", portid, ret);
+    }
+#endif
+    debug("   :: Port " T4LIT(%d,port) " classifies " T4LIT(%d) " packet types\n", portid, nb_ptypes);
+}
+#endif
+
+#ifdef T4P4S_POWER
+// the ports that could not be configured or started with RX interrupts
+bool port_without_rx_intr[RTE_MAX_ETHPORTS];
+#endif
+
 // We have to initialize all ports - create membufs, tx/rx queues, etc.
 void dpdk_init_port(uint8_t nb_ports, uint32_t nb_lcores, uint8_t portid) {
     if (is_port_disabled(portid)) {
@@ -210,14 +352,43 @@ void dpdk_init_port(uint8_t nb_ports, uint32_t nb_lcores, uint8_t portid) {
     uint32_t n_tx_queue = min(nb_lcores, MAX_TX_QUEUE_PER_PORT);
     //uint32_t n_tx_queue = 4;
 
+    struct rte_eth_conf conf = port_conf;
+#ifdef T4P4S_JUMBO
+    // jumbo frames are received into chained mbufs
+    conf.rxmode.max_rx_pkt_len = MAX_JUMBO_PKT_LEN;
+#if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
+    conf.rxmode.offloads |= DEV_RX_OFFLOAD_JUMBO_FRAME | DEV_RX_OFFLOAD_SCATTER;
+#else
+    conf.rxmode.jumbo_frame    = 1;
+    conf.rxmode.enable_scatter = 1;
+#endif
+#endif
+    negotiate_offloads(portid, &conf);
+#ifdef T4P4S_POWER
+    // idle lcores can wait for RX interrupts, see idle_back_off
+    conf.intr_conf.rxq = port_without_rx_intr[portid] ? 0 : 1;
+#endif
+
     debug(" :::: Creating queues: nb_rxq=%d nb_txq=%u\n",
           nb_rx_queue, (unsigned)n_tx_queue );
     int ret = rte_eth_dev_configure(portid, nb_rx_queue,
-                                (uint16_t)n_tx_queue, &port_conf);
+                                (uint16_t)n_tx_queue, &conf);
+#ifdef T4P4S_POWER
+    if (ret < 0 && conf.intr_conf.rxq == 1) {
+        debug("   :: Port %d does not support RX interrupts, its lcores will only sleep when idle\n", portid);
+        port_without_rx_intr[portid] = true;
+        conf.intr_conf.rxq = 0;
+        ret = rte_eth_dev_configure(portid, nb_rx_queue, (uint16_t)n_tx_queue, &conf);
+    }
+#endif
     if (ret < 0)
         rte_exit(EXIT_FAILURE, "Cannot configure device: err=%d, port=%d\n",
                  ret, portid);
 
+#ifdef T4P4S_PTYPE
+    request_ptypes(portid);
+#endif
+
     rte_eth_macaddr_get(portid, &ports_eth_addr[portid]);
     print_port_mac((unsigned)portid, ports_eth_addr[portid].addr_bytes);
 
@@ -239,7 +410,7 @@ void dpdk_init_rx_queue(uint8_t queue, unsigned lcore_id, struct lcore_conf* qco
     debug("rxq=%d,%d,%d \n", portid, queueid, socketid);
     fflush(stdout);
 
-    int ret = rte_eth_rx_queue_setup(portid, queueid, t4p4s_nb_rxd,
+    int ret = rte_eth_rx_queue_setup(portid, queueid, port_nb_rxd[portid],
                                  socketid, NULL, pktmbuf_pool[socketid]);
     if (ret < 0)
         rte_exit(EXIT_FAILURE,
@@ -260,6 +431,30 @@ void dpdk_init_lcore(unsigned lcore_id) {
     }
 }
 
+#ifdef T4P4S_POWER
+// Many ports accept RX interrupts in their configuration, and only fail to start with them.
+// Then the port is configured again without them, and all of its queues are set up again.
+static int restart_port_without_rx_intr(uint8_t nb_ports, uint32_t nb_lcores, uint8_t portid)
+{
+    debug("   :: Port %d cannot start with RX interrupts, its lcores will only sleep when idle\n", portid);
+    port_without_rx_intr[portid] = true;
+    rte_eth_dev_stop(portid);
+
+    dpdk_init_port(nb_ports, nb_lcores, portid);
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rte_lcore_is_enabled(lcore_id) == 0)    continue;
+
+        struct lcore_conf* qconf = &lcore_conf[lcore_id];
+        for (uint8_t queue = 0; queue < qconf->hw.n_rx_queue; ++queue) {
+            if (qconf->hw.rx_queue_list[queue].port_id == portid) {
+                dpdk_init_rx_queue(queue, lcore_id, qconf);
+            }
+        }
+    }
+
+    return rte_eth_dev_start(portid);
+}
+#endif
 
 uint8_t get_nb_ports() {
 #if RTE_VERSION >= RTE_VERSION_NUM(18,05,0,0)
@@ -294,14 +489,22 @@ void dpdk_init_nic()
 
     uint32_t nb_lcores = rte_lcore_count();
 
+    for (uint8_t portid = 0; portid < nb_ports; portid++) {
+        if (is_port_disabled(portid))    continue;
+        adjust_nb_desc(portid);
+    }
+
     reset_mbuf_pools();
     for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
         if (rte_lcore_is_enabled(lcore_id) == 0)   continue;
 
         int socketid = get_socketid(lcore_id);
-        init_mbuf_pool(socketid);
+        init_mbuf_pool(socketid, nb_ports);
     }
+    print_mbuf_pools();
 
+    ipv4_cksum_tx_offload = true;
+    multi_seg_tx_offload  = true;
     for (uint8_t portid = 0; portid < nb_ports; portid++) {
         dpdk_init_port(nb_ports, nb_lcores, portid);
     }
@@ -320,6 +523,11 @@ void dpdk_init_nic()
 
         /* Start device */
         ret = rte_eth_dev_start(portid);
+#ifdef T4P4S_POWER
+        if (ret < 0 && !port_without_rx_intr[portid]) {
+            ret = restart_port_without_rx_intr(nb_ports, nb_lcores, portid);
+        }
+#endif
         if (ret < 0)
             rte_exit(EXIT_FAILURE, "rte_eth_dev_start: err=%d, port=%d\n",
                      ret, portid);
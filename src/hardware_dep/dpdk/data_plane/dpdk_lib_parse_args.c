@@ -18,6 +18,12 @@
 
 extern int promiscuous_on;
 extern int numa_on;
+extern bool numa_strict;
+extern uint16_t t4p4s_nb_rxd;
+extern uint16_t t4p4s_nb_txd;
+extern unsigned t4p4s_nb_mbuf;
+extern unsigned t4p4s_mbuf_cache_size;
+extern uint8_t get_nb_ports();
 
 extern int check_lcore_params();
 
@@ -29,12 +35,38 @@ static void print_usage(const char *prgname)
         "  -p PORTMASK: hexadecimal bitmask of ports to configure\n"
         "  -P : enable promiscuous mode\n"
         "  --config (port,queue,lcore): rx queues configuration\n"
+        "  --auto-config: generate the rx queues configuration from the NUMA topology (overrides --config)\n"
         "  --no-numa: optional, disable numa awareness\n"
+        "  --numa-strict: refuse to poll a port from an lcore on another socket\n"
+        "  --rxd N, --txd N: number of RX/TX descriptors per queue\n"
+        "  --mbufs N: number of mbufs per socket (default: calculated from the queues and lcores)\n"
+        "  --mbuf-cache N: size of the per-lcore mbuf cache (0: no cache)\n"
         " which max packet len is PKTLEN in decimal (64-9600)\n"
         "  --hash-entry-num: specify the hash entry number in hexadecimal to be setup\n",
         prgname);
 }
 
+// Parses a decimal number (0 included) that is at most max.
+static int parse_uint_or_zero(const char *str, unsigned long max)
+{
+    char *end = NULL;
+    unsigned long value = strtoul(str, &end, 10);
+    if ((str[0] == '\0') || (end == NULL) || (*end != '\0'))
+        return -1;
+
+    if (value > max)
+        return -1;
+
+    return value;
+}
+
+// Parses a positive decimal number that is at most max.
+static int parse_uint(const char *str, unsigned long max)
+{
+    int value = parse_uint_or_zero(str, max);
+    return value == 0 ? -1 : value;
+}
+
 static int parse_max_pkt_len(const char *pktlen)
 {
     char *end = NULL;
@@ -115,9 +147,77 @@ static int parse_lcore_params(const char *q_arg)
     return 0;
 }
 
+// Generates the (port,queue,lcore) tuples instead of --config.
+// Each enabled port gets one RX queue for each enabled lcore on its socket,
+// so that RSS spreads the traffic of every port over all local lcores.
+// The queues of the ports on the same socket are rotated among the lcores.
+// Note: sets nb_lcore_params and lcore_params.
+static int auto_config_lcore_params()
+{
+    uint8_t nb_ports = get_nb_ports();
+    if (enabled_port_mask == 0) {
+        enabled_port_mask = (1 << nb_ports) - 1;
+    }
+
+    unsigned next_lcore_idx[NB_SOCKETS] = {0};
+    char config_str[1024] = "";
+    int config_len = 0;
+
+    nb_lcore_params = 0;
+    for (uint8_t portid = 0; portid < nb_ports; portid++) {
+        if ((enabled_port_mask & (1 << portid)) == 0)    continue;
+
+        int port_socket = rte_eth_dev_socket_id(portid);
+
+        // the lcores on the socket of the port, or all of them if there are none or the socket is unknown
+        unsigned lcores[RTE_MAX_LCORE];
+        unsigned nb_lcores = 0;
+        for (int pass = 0; pass < 2 && nb_lcores == 0; pass++) {
+            for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+                if (rte_lcore_is_enabled(lcore_id) == 0)    continue;
+                bool is_local = !numa_on || port_socket < 0 || (int)rte_lcore_to_socket_id(lcore_id) == port_socket;
+                if (pass == 0 && !is_local)    continue;
+                lcores[nb_lcores++] = lcore_id;
+            }
+        }
+
+        struct rte_eth_dev_info dev_info;
+        rte_eth_dev_info_get(portid, &dev_info);
+        unsigned nb_queues = RTE_MIN(nb_lcores, RTE_MIN(dev_info.max_rx_queues, MAX_RX_QUEUE_PER_PORT));
+
+        unsigned* next_lcore = &next_lcore_idx[port_socket < 0 ? 0 : port_socket % NB_SOCKETS];
+        for (unsigned queue = 0; queue < nb_queues; queue++) {
+            if (nb_lcore_params >= MAX_LCORE_PARAMS)    return -1;
+
+            unsigned lcore_id = lcores[(*next_lcore)++ % nb_lcores];
+            lcore_params[nb_lcore_params++] = (struct lcore_params) {
+                .port_id  = portid,
+                .queue_id = queue,
+                .lcore_id = lcore_id,
+            };
+
+            if (config_len < (int)sizeof(config_str)) {
+                config_len += snprintf(config_str + config_len, sizeof(config_str) - config_len,
+                                       "%s(%u,%u,%u)", config_len == 0 ? "" : ",", portid, queue, lcore_id);
+            }
+        }
+    }
+
+    RTE_LOG(INFO, P4_FWD, "Automatic configuration: -p 0x%x --config \"%s\"\n", enabled_port_mask, config_str);
+    return nb_lcore_params == 0 ? -1 : 0;
+}
+
 #define CMD_LINE_OPT_CONFIG "config"
+#define CMD_LINE_OPT_AUTO_CONFIG "auto-config"
 #define CMD_LINE_OPT_NO_NUMA "no-numa"
+#define CMD_LINE_OPT_NUMA_STRICT "numa-strict"
 #define CMD_LINE_OPT_HASH_ENTRY_NUM "hash-entry-num"
+#define CMD_LINE_OPT_RXD "rxd"
+#define CMD_LINE_OPT_TXD "txd"
+#define CMD_LINE_OPT_MBUFS "mbufs"
+#define CMD_LINE_OPT_MBUF_CACHE "mbuf-cache"
+
+bool is_auto_config = false;
 
 /* Parse the argument given in the command line of the application */
 static int parse_args(int argc, char **argv)
@@ -128,8 +228,14 @@ static int parse_args(int argc, char **argv)
     char *prgname = argv[0];
     static struct option lgopts[] = {
         {CMD_LINE_OPT_CONFIG,         1, 0, 0},
+        {CMD_LINE_OPT_AUTO_CONFIG,    0, 0, 0},
         {CMD_LINE_OPT_NO_NUMA,        0, 0, 0},
+        {CMD_LINE_OPT_NUMA_STRICT,    0, 0, 0},
         {CMD_LINE_OPT_HASH_ENTRY_NUM, 1, 0, 0},
+        {CMD_LINE_OPT_RXD,            1, 0, 0},
+        {CMD_LINE_OPT_TXD,            1, 0, 0},
+        {CMD_LINE_OPT_MBUFS,          1, 0, 0},
+        {CMD_LINE_OPT_MBUF_CACHE,     1, 0, 0},
         {NULL,                        0, 0, 0}
     };
 
@@ -164,11 +270,62 @@ static int parse_args(int argc, char **argv)
                 }
             }
 
+            if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_AUTO_CONFIG,
+                sizeof(CMD_LINE_OPT_AUTO_CONFIG))) {
+                is_auto_config = true;
+            }
+
             if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_NO_NUMA,
                 sizeof(CMD_LINE_OPT_NO_NUMA))) {
                 printf("numa is disabled \n");
                 numa_on = 0;
             }
+
+            if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_NUMA_STRICT,
+                sizeof(CMD_LINE_OPT_NUMA_STRICT))) {
+                numa_strict = true;
+            }
+
+            if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_RXD, sizeof(CMD_LINE_OPT_RXD))) {
+                ret = parse_uint(optarg, UINT16_MAX);
+                if (ret < 0) {
+                    printf("invalid number of RX descriptors\n");
+                    print_usage(prgname);
+                    return -1;
+                }
+                t4p4s_nb_rxd = ret;
+            }
+
+            if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_TXD, sizeof(CMD_LINE_OPT_TXD))) {
+                ret = parse_uint(optarg, UINT16_MAX);
+                if (ret < 0) {
+                    printf("invalid number of TX descriptors\n");
+                    print_usage(prgname);
+                    return -1;
+                }
+                t4p4s_nb_txd = ret;
+            }
+
+            if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_MBUFS, sizeof(CMD_LINE_OPT_MBUFS))) {
+                ret = parse_uint(optarg, INT32_MAX);
+                if (ret < 0) {
+                    printf("invalid number of mbufs\n");
+                    print_usage(prgname);
+                    return -1;
+                }
+                t4p4s_nb_mbuf = ret;
+            }
+
+            if (!strncmp(lgopts[option_index].name, CMD_LINE_OPT_MBUF_CACHE, sizeof(CMD_LINE_OPT_MBUF_CACHE))) {
+                // 0 turns off the per-lcore caches
+                ret = parse_uint_or_zero(optarg, RTE_MEMPOOL_CACHE_MAX_SIZE);
+                if (ret < 0) {
+                    printf("invalid mbuf cache size\n");
+                    print_usage(prgname);
+                    return -1;
+                }
+                t4p4s_mbuf_cache_size = ret;
+            }
             break;
 
         default:
@@ -199,6 +356,9 @@ void initialize_args(int argc, char **argv)
     if (ret < 0)
         rte_exit(EXIT_FAILURE, "Invalid T4P4S arguments\n");
 
+    if (is_auto_config && auto_config_lcore_params() < 0)
+        rte_exit(EXIT_FAILURE, "Automatic configuration failed\n");
+
     if (check_lcore_params() < 0)
         rte_exit(EXIT_FAILURE, "check_lcore_params failed\n");
 }
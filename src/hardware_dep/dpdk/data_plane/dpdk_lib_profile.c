@@ -0,0 +1,87 @@
+// Copyright 2016 Eotvos Lorand University, Budapest, Hungary
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is included directly from `dpdk_lib.c`.
+
+#ifdef T4P4S_PROFILE
+
+lcore_profile_t lcore_profile[RTE_MAX_LCORE];
+static volatile bool profile_dump_requested = false;
+
+// The dump is done by poll_profile_dump on the control plane thread.
+static void profile_signal_handler(int signum)
+{
+    profile_dump_requested = true;
+}
+
+void init_profile()
+{
+    memset(lcore_profile, 0, sizeof(lcore_profile));
+    signal(PROFILE_SIGNAL, profile_signal_handler);
+}
+
+void poll_profile_dump()
+{
+    if (unlikely(profile_dump_requested))    dump_profile();
+}
+
+// The measurements are read without synchronisation,
+// the lcores keep profiling and forwarding while the dump is in progress.
+void dump_profile()
+{
+    profile_dump_requested = false;
+
+    FILE* out = fopen(T4P4S_PROFILE_FILE, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot open profile output file %s\n", T4P4S_PROFILE_FILE);
+        return;
+    }
+
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rte_lcore_is_enabled(lcore_id) == 0) continue;
+
+        lcore_profile_t* prof = &lcore_profile[lcore_id];
+        for (int point = 0; point < NB_PROFILE_POINTS; ++point) {
+            profile_point_stats_t* stats = &prof->points[point];
+            if (stats->count == 0) continue;
+
+            fprintf(out, "lcore%u;%s %" PRIu64 "\n", lcore_id, profile_point_paths[point], stats->self_cycles);
+
+            printf("lcore %2u %-60s %10" PRIu64 " samples, %8.1f cycles avg, log2 histogram:", lcore_id, profile_point_paths[point], stats->count, (double)stats->self_cycles / stats->count);
+            for (int bucket = 0; bucket < PROFILE_HISTOGRAM_SIZE; ++bucket) {
+                if (stats->histogram[bucket] == 0) continue;
+                printf(" %d:%" PRIu64, bucket, stats->histogram[bucket]);
+            }
+            printf("\n");
+        }
+    }
+
+    fclose(out);
+    printf("Profile written to %s\n", T4P4S_PROFILE_FILE);
+    fflush(stdout);
+}
+
+#else
+
+void poll_profile_dump()
+{
+}
+
+void dump_profile()
+{
+    debug(" " T4LIT(!!!!,warning) " Profile dump requested, but the switch was not compiled with the " T4LIT(profile) " option\n");
+}
+
+#endif
@@ -0,0 +1,170 @@
+// Copyright 2018 Eotvos Lorand University, Budapest, Hungary
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is included directly from `dpdk_lib.c`.
+
+#ifdef T4P4S_REBALANCE
+
+// Each lcore measures the cycles it spends on the non-empty bursts of its RX queues.
+// Every T4P4S_REBALANCE_PERIOD_MS, one of the lcores compares the loads of the lcores,
+// and if the busiest one is much busier than the least busy one,
+// it asks the busiest lcore to hand over one of its queues.
+//
+// The handover happens between two RX rounds, so a queue is never polled by two lcores:
+//   1. the rebalancing lcore sets rebalance_out_* of the source lcore
+//   2. the source lcore removes the queue from its list, flushes its TX buffers,
+//      and puts the queue into rebalance_in of the destination lcore
+//   3. the destination lcore appends the queue to its list
+// Only one handover is in progress at a time.
+
+uint64_t rebalance_prev_tsc = 0;
+rte_atomic32_t rebalance_lock = RTE_ATOMIC32_INIT(0);
+uint64_t rebalance_prev_busy[RTE_MAX_ETHPORTS][MAX_RX_QUEUE_PER_PORT];
+uint64_t rebalance_queue_loads[RTE_MAX_LCORE][MAX_RX_QUEUE_PER_LCORE];
+
+uint64_t rebalance_moves = 0;
+uint32_t rebalance_imbalance_permille = 0; // busiest lcore's load compared to the average, in the last period
+
+static bool is_handover_in_progress()
+{
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rebalance_is_pending(&lcore_conf[lcore_id].hw))    return true;
+    }
+    return false;
+}
+
+// Returns the busy cycles of the queue since the last period.
+static uint64_t queue_load(struct lcore_rx_queue* queue)
+{
+    uint64_t* prev = &rebalance_prev_busy[queue->port_id][queue->queue_id];
+    uint64_t load = queue->busy_cycles - *prev;
+    *prev = queue->busy_cycles;
+    return load;
+}
+
+// Chooses the queue of the source whose move brings the two loads closest.
+// Returns -1 if no move would lower the larger load.
+static int choose_queue_to_move(uint64_t src_queue_loads[], int queue_count, uint64_t src_load, uint64_t dst_load)
+{
+    int best = -1;
+    uint64_t best_max_load = src_load;
+    for (int i = 0; i < queue_count; i++) {
+        uint64_t max_load = RTE_MAX(src_load - src_queue_loads[i], dst_load + src_queue_loads[i]);
+        if (max_load < best_max_load) {
+            best = i;
+            best_max_load = max_load;
+        }
+    }
+    return best;
+}
+
+static void request_handover(unsigned src, int queue_idx, unsigned dst)
+{
+    struct lcore_hardware_conf* hw = &lcore_conf[src].hw;
+    hw->rebalance_out_idx   = queue_idx;
+    hw->rebalance_out_lcore = dst;
+    rte_smp_wmb();
+    hw->rebalance_out_ready = true;
+}
+
+static void rebalance_queues_locked(uint64_t now)
+{
+    // the queue lists do not change while no handover is in progress
+    if (is_handover_in_progress())    return;
+
+    uint64_t elapsed = now - rebalance_prev_tsc;
+    rebalance_prev_tsc = now;
+
+    uint64_t loads[RTE_MAX_LCORE];
+    uint64_t total_load = 0;
+    unsigned nb_lcores = 0;
+    int busiest = -1, idlest = -1;
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        struct lcore_hardware_conf* hw = &lcore_conf[lcore_id].hw;
+        if (!hw->rebalance_is_active)    continue;
+
+        loads[lcore_id] = 0;
+        for (unsigned i = 0; i < hw->n_rx_queue; i++) {
+            rebalance_queue_loads[lcore_id][i] = queue_load(&hw->rx_queue_list[i]);
+            loads[lcore_id] += rebalance_queue_loads[lcore_id][i];
+        }
+
+        total_load += loads[lcore_id];
+        ++nb_lcores;
+        if (busiest == -1 || loads[lcore_id] > loads[busiest])   busiest = lcore_id;
+        if (idlest  == -1 || loads[lcore_id] < loads[idlest])    idlest  = lcore_id;
+    }
+
+    if (nb_lcores < 2 || total_load == 0)    return;
+
+    rebalance_imbalance_permille = 1000 * loads[busiest] * nb_lcores / total_load;
+
+    bool is_busy       = loads[busiest] * 100 > elapsed * T4P4S_REBALANCE_MIN_BUSY_PERCENT;
+    bool is_imbalanced = rebalance_imbalance_permille > T4P4S_REBALANCE_THRESHOLD_PERMILLE;
+    struct lcore_hardware_conf* src = &lcore_conf[busiest].hw;
+    struct lcore_hardware_conf* dst = &lcore_conf[idlest].hw;
+    if (!is_busy || !is_imbalanced || src->n_rx_queue < 2 || dst->n_rx_queue >= MAX_RX_QUEUE_PER_LCORE)    return;
+
+    int queue_idx = choose_queue_to_move(rebalance_queue_loads[busiest], src->n_rx_queue, loads[busiest], loads[idlest]);
+    if (queue_idx < 0)    return;
+
+    struct lcore_rx_queue* queue = &src->rx_queue_list[queue_idx];
+    RTE_LOG(INFO, P4_FWD, "Rebalancing: moving RX queue %u of port %u from lcore %d (%" PRIu64 "%% busy) to lcore %d (%" PRIu64 "%% busy), imbalance %u.%03u\n",
+            queue->queue_id, queue->port_id,
+            busiest, 100 * loads[busiest] / elapsed,
+            idlest,  100 * loads[idlest]  / elapsed,
+            rebalance_imbalance_permille / 1000, rebalance_imbalance_permille % 1000);
+
+    ++rebalance_moves;
+    request_handover(busiest, queue_idx, idlest);
+}
+
+// Called by all lcores in each round, only one of them rebalances in a period.
+void rebalance_queues()
+{
+    uint64_t now = rte_rdtsc();
+    uint64_t period = rte_get_tsc_hz() / 1000 * T4P4S_REBALANCE_PERIOD_MS;
+    if (likely(now - rebalance_prev_tsc < period))    return;
+
+    if (rte_atomic32_cmpset((volatile uint32_t*)&rebalance_lock.cnt, 0, 1) == 0)    return;
+    rebalance_queues_locked(now);
+    rte_atomic32_clear(&rebalance_lock);
+}
+
+void rebalance_handover(unsigned lcore_id)
+{
+    struct lcore_hardware_conf* hw = &lcore_conf[lcore_id].hw;
+
+    if (hw->rebalance_in_ready) {
+        rte_smp_rmb();
+        hw->rx_queue_list[hw->n_rx_queue] = hw->rebalance_in;
+        ++hw->n_rx_queue;
+        hw->rebalance_in_ready = false;
+    }
+
+    if (hw->rebalance_out_ready) {
+        rte_smp_rmb();
+        struct lcore_hardware_conf* dst = &lcore_conf[hw->rebalance_out_lcore].hw;
+
+        dst->rebalance_in = hw->rx_queue_list[hw->rebalance_out_idx];
+        --hw->n_rx_queue;
+        hw->rx_queue_list[hw->rebalance_out_idx] = hw->rx_queue_list[hw->n_rx_queue];
+
+        rte_smp_wmb();
+        dst->rebalance_in_ready = true;
+        hw->rebalance_out_ready = false;
+    }
+}
+
+#endif
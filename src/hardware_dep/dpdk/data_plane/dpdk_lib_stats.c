@@ -0,0 +1,384 @@
+// Copyright 2016 Eotvos Lorand University, Budapest, Hungary
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// This file is included directly from `dpdk_lib.c`.
+
+// Fills the counters of the table by aggregating all lcores.
+// The counters are read without synchronisation, so they may lag slightly behind.
+void get_table_counters(int tableid, struct p4_table_counters* counters)
+{
+    memset(counters, 0, sizeof(struct p4_table_counters));
+
+    strncpy(counters->table_name, table_config[tableid].name, P4_MAX_TABLE_NAME_LEN);
+    counters->table_name[P4_MAX_TABLE_NAME_LEN-1] = '\0';
+    counters->tsc_hz = rte_get_tsc_hz();
+
+#ifdef T4P4S_STATS
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rte_lcore_is_enabled(lcore_id) == 0) continue;
+
+        table_stats_t* stats = &lcore_conf[lcore_id].state.table_stats[tableid];
+        counters->lookups         += stats->lookups;
+        counters->hits            += stats->hits;
+        counters->misses          += stats->misses;
+        counters->default_actions += stats->default_actions;
+        counters->sampled_lookups += stats->sampled_lookups;
+        counters->sampled_cycles  += stats->sampled_cycles;
+    }
+#endif
+
+    // all sockets hold the same entries, the first one is representative
+    for (int socketid = 0; socketid < NB_SOCKETS; socketid++) {
+        if (state[socketid].tables[0][0] == NULL) continue;
+
+        lookup_table_t* t = state[socketid].tables[tableid][state[socketid].active_replica[tableid]];
+        counters->entry_count = t->entry.entry_count;
+        counters->entry_size  = t->entry.entry_size;
+        counters->max_size    = t->max_size;
+        break;
+    }
+}
+
+//=============================================================================
+// Latency
+
+#ifdef T4P4S_LATENCY
+
+#if RTE_VERSION >= RTE_VERSION_NUM(19,11,0,0)
+
+#include <rte_mbuf_dyn.h>
+
+int latency_tsc_dynfield_offset = -1;
+
+void init_latency()
+{
+    static const struct rte_mbuf_dynfield rx_tsc_desc = {
+        .name  = "t4p4s_rx_tsc",
+        .size  = sizeof(uint64_t),
+        .align = __alignof__(uint64_t),
+    };
+
+    latency_tsc_dynfield_offset = rte_mbuf_dynfield_register(&rx_tsc_desc);
+    if (latency_tsc_dynfield_offset < 0)
+        rte_exit(EXIT_FAILURE, "Cannot register the mbuf field for latency measurement: %s\n", rte_strerror(rte_errno));
+}
+
+#else
+
+void init_latency()
+{
+    // the timestamp is stored in udata64
+}
+
+#endif
+
+static uint64_t latency_cycles_to_ns(uint64_t cycles)
+{
+    return (uint64_t)((double)cycles * 1E9 / rte_get_tsc_hz());
+}
+
+// Returns the lower bound of the bucket that contains the given percentile.
+uint64_t latency_percentile(latency_histogram_t* hist, double percentile)
+{
+    if (hist->count == 0)    return 0;
+
+    uint64_t rank = (uint64_t)(hist->count * percentile / 100.0);
+    if (rank >= hist->count)    rank = hist->count - 1;
+
+    uint64_t seen = 0;
+    for (int idx = 0; idx < LATENCY_BUCKET_COUNT; idx++) {
+        seen += hist->buckets[idx];
+        if (seen > rank)    return latency_bucket_value(idx);
+    }
+
+    return hist->max_cycles;
+}
+
+// The histograms are read without synchronisation, see get_table_counters.
+static void merge_latency_histograms(latency_histogram_t* all)
+{
+    memset(all, 0, sizeof(latency_histogram_t));
+
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rte_lcore_is_enabled(lcore_id) == 0) continue;
+
+        latency_histogram_t* hist = &lcore_conf[lcore_id].hw.latency;
+        all->count        += hist->count;
+        all->total_cycles += hist->total_cycles;
+        all->max_cycles    = RTE_MAX(all->max_cycles, hist->max_cycles);
+        for (int idx = 0; idx < LATENCY_BUCKET_COUNT; idx++) {
+            all->buckets[idx] += hist->buckets[idx];
+        }
+    }
+}
+
+void print_latency()
+{
+    latency_histogram_t all;
+    merge_latency_histograms(&all);
+
+    if (all.count == 0) {
+        printf("No latency samples were recorded\n");
+        return;
+    }
+
+    printf("Latency of %" PRIu64 " packets (RX to TX, ns): mean %" PRIu64 ", p50 %" PRIu64 ", p90 %" PRIu64 ", p99 %" PRIu64 ", p99.9 %" PRIu64 ", max %" PRIu64 "\n",
+           all.count,
+           latency_cycles_to_ns(all.total_cycles / all.count),
+           latency_cycles_to_ns(latency_percentile(&all, 50.0)),
+           latency_cycles_to_ns(latency_percentile(&all, 90.0)),
+           latency_cycles_to_ns(latency_percentile(&all, 99.0)),
+           latency_cycles_to_ns(latency_percentile(&all, 99.9)),
+           latency_cycles_to_ns(all.max_cycles));
+}
+
+#endif
+
+//=============================================================================
+// Telemetry
+
+// The endpoints can be queried with usertools/dpdk-telemetry.py, e.g. /t4p4s/lcores.
+// The counters are only read here, the lcores do not do any extra work for them.
+
+#if RTE_VERSION >= RTE_VERSION_NUM(20,5,0,0)
+
+#include <rte_telemetry.h>
+
+#ifdef T4P4S_STATS
+
+static int telemetry_lcores(const char* cmd, const char* params, struct rte_tel_data* d)
+{
+    rte_tel_data_start_dict(d);
+
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rte_lcore_is_enabled(lcore_id) == 0) continue;
+
+        struct lcore_stats* stats = &lcore_conf[lcore_id].hw.stats;
+        struct rte_tel_data* lcore_data = rte_tel_data_alloc();
+        if (lcore_data == NULL)    return -ENOMEM;
+
+        rte_tel_data_start_dict(lcore_data);
+        rte_tel_data_add_dict_u64(lcore_data, "rx_queues",   lcore_conf[lcore_id].hw.n_rx_queue);
+        rte_tel_data_add_dict_u64(lcore_data, "rx_packets",  stats->rx_packets);
+        rte_tel_data_add_dict_u64(lcore_data, "tx_packets",  stats->tx_packets);
+        rte_tel_data_add_dict_u64(lcore_data, "tx_drops",    stats->tx_drops);
+        rte_tel_data_add_dict_u64(lcore_data, "tx_backlogged", stats->tx_backlogged);
+        rte_tel_data_add_dict_u64(lcore_data, "polls",       stats->polls);
+        rte_tel_data_add_dict_u64(lcore_data, "empty_polls", stats->empty_polls);
+        rte_tel_data_add_dict_u64(lcore_data, "empty_poll_permille", stats->polls == 0 ? 0 : 1000 * stats->empty_polls / stats->polls);
+        rte_tel_data_add_dict_u64(lcore_data, "header_segs", stats->header_segs);
+#ifdef T4P4S_POWER
+        rte_tel_data_add_dict_u64(lcore_data, "sleep_cycles", stats->sleep_cycles);
+        rte_tel_data_add_dict_u64(lcore_data, "intr_wakeups", stats->intr_wakeups);
+#endif
+#ifdef T4P4S_EVENTDEV
+        rte_tel_data_add_dict_u64(lcore_data, "events",      stats->events);
+        rte_tel_data_add_dict_u64(lcore_data, "event_drops", stats->event_drops);
+#endif
+
+        char name[32];
+        snprintf(name, sizeof(name), "lcore%u", lcore_id);
+        rte_tel_data_add_dict_container(d, name, lcore_data, 0);
+    }
+
+    return 0;
+}
+
+static int telemetry_ports(const char* cmd, const char* params, struct rte_tel_data* d)
+{
+    rte_tel_data_start_dict(d);
+
+    for (unsigned portid = 0; portid < get_nb_ports(); portid++) {
+        if ((enabled_port_mask & (1 << portid)) == 0) continue;
+
+        struct rte_eth_stats eth_stats;
+        if (rte_eth_stats_get(portid, &eth_stats) != 0) continue;
+
+        struct rte_tel_data* port_data = rte_tel_data_alloc();
+        if (port_data == NULL)    return -ENOMEM;
+
+        rte_tel_data_start_dict(port_data);
+        rte_tel_data_add_dict_u64(port_data, "ipackets",  eth_stats.ipackets);
+        rte_tel_data_add_dict_u64(port_data, "opackets",  eth_stats.opackets);
+        rte_tel_data_add_dict_u64(port_data, "ibytes",    eth_stats.ibytes);
+        rte_tel_data_add_dict_u64(port_data, "obytes",    eth_stats.obytes);
+        rte_tel_data_add_dict_u64(port_data, "imissed",   eth_stats.imissed);
+        rte_tel_data_add_dict_u64(port_data, "ierrors",   eth_stats.ierrors);
+        rte_tel_data_add_dict_u64(port_data, "oerrors",   eth_stats.oerrors);
+        rte_tel_data_add_dict_u64(port_data, "rx_nombuf", eth_stats.rx_nombuf);
+
+        char name[32];
+        snprintf(name, sizeof(name), "port%u", portid);
+        rte_tel_data_add_dict_container(d, name, port_data, 0);
+    }
+
+    return 0;
+}
+
+// Parameter: the port id.
+static int telemetry_port_xstats(const char* cmd, const char* params, struct rte_tel_data* d)
+{
+    if (params == NULL || strlen(params) == 0)    return -EINVAL;
+
+    uint16_t portid = (uint16_t)atoi(params);
+    if (!rte_eth_dev_is_valid_port(portid))    return -EINVAL;
+
+    int len = rte_eth_xstats_get_names(portid, NULL, 0);
+    if (len < 0)    return -EINVAL;
+
+    struct rte_eth_xstat_name* xstats_names = malloc(sizeof(struct rte_eth_xstat_name) * len);
+    struct rte_eth_xstat* xstats = malloc(sizeof(struct rte_eth_xstat) * len);
+    if (xstats_names == NULL || xstats == NULL) {
+        free(xstats_names);
+        free(xstats);
+        return -ENOMEM;
+    }
+
+    int ret = 0;
+    if (rte_eth_xstats_get_names(portid, xstats_names, len) != len || rte_eth_xstats_get(portid, xstats, len) != len) {
+        ret = -EINVAL;
+    } else {
+        rte_tel_data_start_dict(d);
+        for (int i = 0; i < len; i++) {
+            rte_tel_data_add_dict_u64(d, xstats_names[i].name, xstats[i].value);
+        }
+    }
+
+    free(xstats_names);
+    free(xstats);
+    return ret;
+}
+
+static void telemetry_add_mempool(struct rte_mempool* mp, void* arg)
+{
+    struct rte_tel_data* d = (struct rte_tel_data*)arg;
+
+    struct rte_tel_data* mempool_data = rte_tel_data_alloc();
+    if (mempool_data == NULL)    return;
+
+    rte_tel_data_start_dict(mempool_data);
+    rte_tel_data_add_dict_u64(mempool_data, "size",      mp->size);
+    rte_tel_data_add_dict_u64(mempool_data, "in_use",    rte_mempool_in_use_count(mp));
+    rte_tel_data_add_dict_u64(mempool_data, "available", rte_mempool_avail_count(mp));
+    rte_tel_data_add_dict_u64(mempool_data, "socket",    mp->socket_id);
+    rte_tel_data_add_dict_container(d, mp->name, mempool_data, 0);
+}
+
+static int telemetry_mempools(const char* cmd, const char* params, struct rte_tel_data* d)
+{
+    rte_tel_data_start_dict(d);
+    rte_mempool_walk(telemetry_add_mempool, d);
+    return 0;
+}
+
+#endif
+
+#ifdef T4P4S_LATENCY
+
+static void telemetry_add_latency(struct rte_tel_data* d, latency_histogram_t* hist)
+{
+    rte_tel_data_add_dict_u64(d, "count",   hist->count);
+    rte_tel_data_add_dict_u64(d, "mean_ns", latency_cycles_to_ns(hist->count == 0 ? 0 : hist->total_cycles / hist->count));
+    rte_tel_data_add_dict_u64(d, "p50_ns",  latency_cycles_to_ns(latency_percentile(hist, 50.0)));
+    rte_tel_data_add_dict_u64(d, "p90_ns",  latency_cycles_to_ns(latency_percentile(hist, 90.0)));
+    rte_tel_data_add_dict_u64(d, "p99_ns",  latency_cycles_to_ns(latency_percentile(hist, 99.0)));
+    rte_tel_data_add_dict_u64(d, "p999_ns", latency_cycles_to_ns(latency_percentile(hist, 99.9)));
+    rte_tel_data_add_dict_u64(d, "max_ns",  latency_cycles_to_ns(hist->max_cycles));
+}
+
+static int telemetry_latency(const char* cmd, const char* params, struct rte_tel_data* d)
+{
+    latency_histogram_t all;
+    merge_latency_histograms(&all);
+
+    rte_tel_data_start_dict(d);
+    telemetry_add_latency(d, &all);
+
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rte_lcore_is_enabled(lcore_id) == 0) continue;
+
+        struct rte_tel_data* lcore_data = rte_tel_data_alloc();
+        if (lcore_data == NULL)    return -ENOMEM;
+
+        rte_tel_data_start_dict(lcore_data);
+        telemetry_add_latency(lcore_data, &lcore_conf[lcore_id].hw.latency);
+
+        char name[32];
+        snprintf(name, sizeof(name), "lcore%u", lcore_id);
+        rte_tel_data_add_dict_container(d, name, lcore_data, 0);
+    }
+
+    return 0;
+}
+
+#endif
+
+#ifdef T4P4S_REBALANCE
+
+// The queue lists may change during a handover, the result is only indicative then.
+static int telemetry_rx_queues(const char* cmd, const char* params, struct rte_tel_data* d)
+{
+    rte_tel_data_start_dict(d);
+    rte_tel_data_add_dict_u64(d, "moves", rebalance_moves);
+    rte_tel_data_add_dict_u64(d, "imbalance_permille", rebalance_imbalance_permille);
+
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        struct lcore_hardware_conf* hw = &lcore_conf[lcore_id].hw;
+        if (!hw->rebalance_is_active) continue;
+
+        struct rte_tel_data* lcore_data = rte_tel_data_alloc();
+        if (lcore_data == NULL)    return -ENOMEM;
+
+        rte_tel_data_start_dict(lcore_data);
+        for (unsigned i = 0; i < hw->n_rx_queue; i++) {
+            char queue_name[32];
+            snprintf(queue_name, sizeof(queue_name), "port%u_queue%u_busy_cycles", hw->rx_queue_list[i].port_id, hw->rx_queue_list[i].queue_id);
+            rte_tel_data_add_dict_u64(lcore_data, queue_name, hw->rx_queue_list[i].busy_cycles);
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "lcore%u", lcore_id);
+        rte_tel_data_add_dict_container(d, name, lcore_data, 0);
+    }
+
+    return 0;
+}
+
+#endif
+
+void init_telemetry()
+{
+#ifdef T4P4S_STATS
+    rte_telemetry_register_cmd("/t4p4s/lcores",      telemetry_lcores,      "Per-lcore RX/TX counters and empty poll ratios. Takes no parameters");
+    rte_telemetry_register_cmd("/t4p4s/ports",       telemetry_ports,       "Basic statistics of the enabled ports. Takes no parameters");
+    rte_telemetry_register_cmd("/t4p4s/port_xstats", telemetry_port_xstats, "Extended statistics of a port. Parameters: int port_id");
+    rte_telemetry_register_cmd("/t4p4s/mempools",    telemetry_mempools,    "Occupancy of the mempools. Takes no parameters");
+#endif
+#ifdef T4P4S_LATENCY
+    rte_telemetry_register_cmd("/t4p4s/latency",     telemetry_latency,     "RX to TX latency percentiles, overall and per lcore. Takes no parameters");
+#endif
+#ifdef T4P4S_REBALANCE
+    rte_telemetry_register_cmd("/t4p4s/rx_queues",   telemetry_rx_queues,   "RX queues of the lcores with their busy cycles, and the imbalance of the last rebalancing period. Takes no parameters");
+#endif
+}
+
+#else
+
+void init_telemetry()
+{
+    debug(" " T4LIT(!!!!,warning) " Telemetry needs DPDK 20.05 or newer, the statistics are not exported\n");
+}
+
+#endif
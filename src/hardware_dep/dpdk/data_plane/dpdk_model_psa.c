@@ -49,6 +49,10 @@ int extract_ingress_port(packet_descriptor_t* pd) {
     return GET_INT32_AUTO_PACKET(pd, header_instance_all_metadatas, field_instance_psa_ingress_parser_input_metadata_ingress_port);
 }
 
+int extract_mcast_grp(packet_descriptor_t* pd) {
+    return GET_INT32_AUTO_PACKET(pd, header_instance_all_metadatas, field_instance_psa_ingress_output_metadata_multicast_group);
+}
+
 void set_handle_packet_metadata(packet_descriptor_t* pd, uint32_t portid)
 {
     int res32; // needed for the macro
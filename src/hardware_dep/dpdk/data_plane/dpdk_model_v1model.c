@@ -18,6 +18,8 @@
 
 #include <rte_ip.h>
 
+extern bool ipv4_cksum_tx_offload;
+
 void transfer_to_egress(packet_descriptor_t* pd)
 {
 	int res32; // needed for the macro
@@ -33,51 +35,281 @@ int extract_ingress_port(packet_descriptor_t* pd) {
     return GET_INT32_AUTO_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_ingress_port);
 }
 
+int extract_mcast_grp(packet_descriptor_t* pd) {
+    return GET_INT32_AUTO_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_mcast_grp);
+}
+
 void set_handle_packet_metadata(packet_descriptor_t* pd, uint32_t portid)
 {
     int res32; // needed for the macro
     MODIFY_INT32_INT32_BITS_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_ingress_port, portid);
 }
 
+static uint32_t finish_csum16(uint32_t sum) {
+    return (sum == 0xffff) ? sum : ((~sum) & 0xffff);
+}
+
+static uint16_t fold_csum16(uint64_t sum) {
+    sum = (sum & 0xffff) + ((sum >> 16) & 0xffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return sum;
+}
+
+// The contribution of a value to the sum when it ends shift bits before the end of a 16 bit word (in host byte order).
+static uint16_t csum16_word_value(uint32_t value, uint8_t shift) {
+    return fold_csum16((uint64_t)value << shift);
+}
+
+static uint32_t current_csum16_value(const csum16_value_t* v) {
+    uint32_t value = v->value;
+    if (v->field.byte_addr != NULL) {
+        EXTRACT_INT32_AUTO(v->field, value)
+    }
+    return value;
+}
+
+// The sum of the values that come before the header span in the data (e.g. the TCP/UDP pseudo header),
+// in the same byte order as the sum of the packet bytes.
+static uint16_t sum_csum16_values(const csum16_value_t* values, int value_count) {
+    uint32_t sum = 0;
+    for (int i = 0; i < value_count; ++i) {
+        sum += csum16_word_value(current_csum16_value(&values[i]), values[i].shift);
+    }
+    return rte_cpu_to_be_16(fold_csum16(sum));
+}
+
+// The sum of the packet payload, which comes after data_length bytes of the data.
+static uint16_t sum_csum16_payload(int data_length, packet_descriptor_t* pd) {
+    uint16_t sum = 0;
+    if (pd->payload_length > 0) {
+        rte_raw_cksum_mbuf(pd->wrapper, pd->parsed_length, pd->payload_length, &sum);
+    }
+    // at an odd offset, the payload bytes are at the other half of the 16 bit words
+    return data_length % 2 == 0 ? sum : rte_bswap16(sum);
+}
+
+// The span contains the checksum field as well. Its current value is cancelled out
+// by adding its complement, which gives the sum of the span with a zero checksum field.
+static uint32_t calculate_csum16_inplace(const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, bool with_payload, packet_descriptor_t* pd) {
+    uint64_t sum = sum_csum16_values(values, value_count) + rte_raw_cksum(span.buffer, span.buffer_size);
+    if (with_payload) {
+        // the values make up whole 16 bit words
+        sum += sum_csum16_payload(span.buffer_size, pd);
+    }
+
+    uint16_t current_cksum;
+    memcpy(&current_cksum, cksum_field_handle.byte_addr, sizeof(uint16_t));
+    sum += (uint16_t)~current_cksum;
+
+    return finish_csum16(fold_csum16(sum));
+}
+
+// Returns the length of the L2 header as recognised by the NIC, or -1 if it is unknown.
+static int ptype_l2_len(uint32_t packet_type) {
+    switch (packet_type & RTE_PTYPE_L2_MASK) {
+        case RTE_PTYPE_L2_ETHER:      return 14;
+        case RTE_PTYPE_L2_ETHER_VLAN: return 18;
+        case RTE_PTYPE_L2_ETHER_QINQ: return 22;
+        default:                      return -1;
+    }
+}
+
+// Checks that the span is a whole IPv4 header (including options)
+// with the checksum field at its usual place.
+static bool is_ipv4_header(struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle) {
+    return (span.buffer[0] >> 4) == 4
+        && span.buffer_size == (span.buffer[0] & 0x0f) * 4
+        && cksum_field_handle.byte_addr == span.buffer + 10;
+}
+
+// The RX checksum flags of the NIC are only about the outermost IPv4 header.
+static bool is_nic_verified_ipv4_header(struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, packet_descriptor_t* pd) {
+    return RTE_ETH_IS_IPV4_HDR(pd->wrapper->packet_type)
+        && span.buffer == (uint8_t*)pd->data + ptype_l2_len(pd->wrapper->packet_type)
+        && is_ipv4_header(span, cksum_field_handle);
+}
+
+// The mbuf describes only one IPv4 header for the NIC to checksum;
+// if another header is already offloaded, the checksum is calculated in software.
+static bool can_offload_ipv4_csum16(struct uint8_buffer_s span, packet_descriptor_t* pd) {
+    return ipv4_cksum_tx_offload && (pd->ipv4_cksum_offload_hdr == NULL || pd->ipv4_cksum_offload_hdr == span.buffer);
+}
+
+static void offload_ipv4_csum16(struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, SHORT_STDPARAMS) {
+    uint32_t res32;
+
+    debug("       : Packet checksum will be calculated by the " T4LIT(NIC,status) "\n");
+
+    // if the headers are reordered on emit, l2_len is set again in store_headers_for_emit
+    pd->wrapper->l2_len = span.buffer - (uint8_t*)pd->data;
+    pd->wrapper->l3_len = span.buffer_size;
+    pd->wrapper->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
+    pd->ipv4_cksum_offload_hdr = span.buffer;
+    MODIFY_INT32_INT32_BITS(cksum_field_handle, 0)
+}
+
+static void check_csum16(uint32_t calculated_cksum, bitfield_handle_t cksum_field_handle, SHORT_STDPARAMS) {
+    uint32_t res32, current_cksum = 0;
+    EXTRACT_INT32_BITS(cksum_field_handle, current_cksum)
+
+#ifdef T4P4S_DEBUG
+    if (current_cksum == calculated_cksum) {
+        debug("      : Packet checksum is " T4LIT(ok,success) ": " T4LIT(%04x,bytes) "\n", current_cksum);
+    } else {
+        debug("    " T4LIT(!!,error) " Packet checksum is " T4LIT(wrong,error) ": " T4LIT(%04x,bytes) ", calculated checksum is " T4LIT(%04x,bytes) "\n", current_cksum, calculated_cksum);
+    }
+#endif
+
+    if (unlikely(calculated_cksum != current_cksum)) {
+        MODIFY_INT32_INT32_BITS_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_checksum_error, 1)
+    }
+}
+
+static void write_csum16(uint32_t calculated_cksum, bitfield_handle_t cksum_field_handle, SHORT_STDPARAMS) {
+    uint32_t res32;
+
+    debug("       : Packet checksum " T4LIT(updated,status) " to " T4LIT(%04x,bytes) "\n", calculated_cksum);
+
+    MODIFY_INT32_INT32_BITS(cksum_field_handle, calculated_cksum)
+}
+
 void verify_checksum(bool cond, struct uint8_buffer_s data, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
     debug("    : Called extern " T4LIT(verify_checksum,extern) "\n");
-    uint32_t res32, current_cksum = 0, calculated_cksum = 0;
+
+    if (cond && algorithm == enum_HashAlgorithm_csum16) {
+        check_csum16(finish_csum16(rte_raw_cksum(data.buffer, data.buffer_size)), cksum_field_handle, SHORT_STDPARAMS_IN);
+    }
+}
+
+void update_checksum(bool cond, struct uint8_buffer_s data, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
+    debug("    : Called extern " T4LIT(update_checksum,extern) "\n");
+
     if (cond) {
+        uint32_t calculated_cksum = 0;
         if (algorithm == enum_HashAlgorithm_csum16) {
-            calculated_cksum = rte_raw_cksum(data.buffer, data.buffer_size);
-            calculated_cksum = (calculated_cksum == 0xffff) ? calculated_cksum : ((~calculated_cksum) & 0xffff);
-            EXTRACT_INT32_BITS(cksum_field_handle, current_cksum)
+            calculated_cksum = finish_csum16(rte_raw_cksum(data.buffer, data.buffer_size));
         }
 
-#ifdef T4P4S_DEBUG
-        if (current_cksum == calculated_cksum) {
-            debug("      : Packet checksum is " T4LIT(ok,success) ": " T4LIT(%04x,bytes) "\n", current_cksum);
-        } else {
-            debug("    " T4LIT(!!,error) " Packet checksum is " T4LIT(wrong,error) ": " T4LIT(%04x,bytes) ", calculated checksum is " T4LIT(%04x,bytes) "\n", current_cksum, calculated_cksum);
+        write_csum16(calculated_cksum, cksum_field_handle, SHORT_STDPARAMS_IN);
+    }
+}
+
+void verify_checksum_with_payload(bool cond, struct uint8_buffer_s data, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
+    debug("    : Called extern " T4LIT(verify_checksum_with_payload,extern) "\n");
+
+    if (cond && algorithm == enum_HashAlgorithm_csum16) {
+        uint64_t sum = rte_raw_cksum(data.buffer, data.buffer_size) + sum_csum16_payload(data.buffer_size, pd);
+        check_csum16(finish_csum16(fold_csum16(sum)), cksum_field_handle, SHORT_STDPARAMS_IN);
+    }
+}
+
+void update_checksum_with_payload(bool cond, struct uint8_buffer_s data, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
+    debug("    : Called extern " T4LIT(update_checksum_with_payload,extern) "\n");
+
+    if (cond) {
+        uint32_t calculated_cksum = 0;
+        if (algorithm == enum_HashAlgorithm_csum16) {
+            uint64_t sum = rte_raw_cksum(data.buffer, data.buffer_size) + sum_csum16_payload(data.buffer_size, pd);
+            calculated_cksum = finish_csum16(fold_csum16(sum));
         }
-#endif
 
-        if (unlikely(calculated_cksum != current_cksum)) {
-            MODIFY_INT32_INT32_BITS_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_checksum_error, 1)
+        write_csum16(calculated_cksum, cksum_field_handle, SHORT_STDPARAMS_IN);
+    }
+}
+
+void verify_checksum_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
+    debug("    : Called extern " T4LIT(verify_checksum,extern) " (in place)\n");
+
+    if (cond && algorithm == enum_HashAlgorithm_csum16) {
+        if (value_count == 0 && is_nic_verified_ipv4_header(span, cksum_field_handle, pd)) {
+            uint64_t rx_flags = pd->wrapper->ol_flags & PKT_RX_IP_CKSUM_MASK;
+            if (rx_flags == PKT_RX_IP_CKSUM_GOOD) {
+                debug("      : Packet checksum is " T4LIT(ok,success) " (verified by the NIC)\n");
+                return;
+            }
+            if (rx_flags == PKT_RX_IP_CKSUM_BAD) {
+                uint32_t res32;
+                debug("    " T4LIT(!!,error) " Packet checksum is " T4LIT(wrong,error) " (verified by the NIC)\n");
+                MODIFY_INT32_INT32_BITS_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_checksum_error, 1)
+                return;
+            }
         }
+
+        check_csum16(calculate_csum16_inplace(values, value_count, span, cksum_field_handle, false, pd), cksum_field_handle, SHORT_STDPARAMS_IN);
     }
 }
 
-void update_checksum(bool cond, struct uint8_buffer_s data, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
-    debug("    : Called extern " T4LIT(update_checksum,extern) "\n");
+void update_checksum_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
+    debug("    : Called extern " T4LIT(update_checksum,extern) " (in place)\n");
+
+    if (cond) {
+        if (algorithm == enum_HashAlgorithm_csum16 && value_count == 0 && can_offload_ipv4_csum16(span, pd) && is_ipv4_header(span, cksum_field_handle)) {
+            offload_ipv4_csum16(span, cksum_field_handle, SHORT_STDPARAMS_IN);
+            return;
+        }
+
+        uint32_t calculated_cksum = 0;
+        if (algorithm == enum_HashAlgorithm_csum16) {
+            calculated_cksum = calculate_csum16_inplace(values, value_count, span, cksum_field_handle, false, pd);
+        }
+
+        write_csum16(calculated_cksum, cksum_field_handle, SHORT_STDPARAMS_IN);
+    }
+}
 
-    uint32_t res32, calculated_cksum = 0;
-    if(cond) {
+void verify_checksum_with_payload_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
+    debug("    : Called extern " T4LIT(verify_checksum_with_payload,extern) " (in place)\n");
+
+    if (cond && algorithm == enum_HashAlgorithm_csum16) {
+        check_csum16(calculate_csum16_inplace(values, value_count, span, cksum_field_handle, true, pd), cksum_field_handle, SHORT_STDPARAMS_IN);
+    }
+}
+
+void update_checksum_with_payload_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
+    debug("    : Called extern " T4LIT(update_checksum_with_payload,extern) " (in place)\n");
+
+    if (cond) {
+        uint32_t calculated_cksum = 0;
         if (algorithm == enum_HashAlgorithm_csum16) {
-            calculated_cksum = rte_raw_cksum(data.buffer, data.buffer_size);
-            calculated_cksum = (calculated_cksum == 0xffff) ? calculated_cksum : ((~calculated_cksum) & 0xffff);
+            calculated_cksum = calculate_csum16_inplace(values, value_count, span, cksum_field_handle, true, pd);
         }
 
-        debug("       : Packet checksum " T4LIT(updated,status) " to " T4LIT(%04x,bytes) "\n", calculated_cksum);
+        write_csum16(calculated_cksum, cksum_field_handle, SHORT_STDPARAMS_IN);
+    }
+}
+
+// The changes of the fields are folded into the current checksum: HC' = ~(~HC + ~m + m') (RFC 1624, eqn. 3),
+// where m and m' are the contributions of a field with its value at parsing and with its current value.
+// The data (and the payload) is not read again.
+void update_checksum_incremental(bool cond, struct uint8_buffer_s span, const csum16_value_t* changes, int change_count, bitfield_handle_t cksum_field_handle, SHORT_STDPARAMS) {
+    debug("    : Called extern " T4LIT(update_checksum,extern) " (incremental)\n");
+
+    if (!cond) {
+        return;
+    }
+
+    if (change_count == 0) {
+        debug("       : Packet checksum is " T4LIT(unchanged,status) "\n");
+        return;
+    }
+
+    if (can_offload_ipv4_csum16(span, pd) && is_ipv4_header(span, cksum_field_handle)) {
+        offload_ipv4_csum16(span, cksum_field_handle, SHORT_STDPARAMS_IN);
+        return;
+    }
 
-        // TODO temporarily disabled: this line modifies a lookup table's pointer instead of a checksum field
-        // MODIFY_INT32_INT32_BITS(cksum_field_handle, calculated_cksum)
+    uint32_t delta = 0;
+    for (int i = 0; i < change_count; ++i) {
+        delta += (uint16_t)~csum16_word_value(changes[i].value, changes[i].shift);
+        delta += csum16_word_value(current_csum16_value(&changes[i]), changes[i].shift);
     }
+
+    uint16_t current_cksum;
+    memcpy(&current_cksum, cksum_field_handle.byte_addr, sizeof(uint16_t));
+    uint32_t sum = (uint16_t)~current_cksum + rte_cpu_to_be_16(fold_csum16(delta));
+
+    write_csum16(finish_csum16(fold_csum16(sum)), cksum_field_handle, SHORT_STDPARAMS_IN);
 }
 
 void verify_checksum_offload(bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, SHORT_STDPARAMS) {
@@ -94,14 +326,12 @@ void verify_checksum_offload(bitfield_handle_t cksum_field_handle, enum enum_Has
 void update_checksum_offload(bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm, uint8_t len_l2, uint8_t len_l3, SHORT_STDPARAMS) {
     debug("    : Called extern " T4LIT(update_checksum_offload,extern) "\n");
 
-    pd->wrapper->l2_len = len_l2;
-    pd->wrapper->l3_len = len_l3;
-    pd->wrapper->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM;
-    uint32_t res32;
-    MODIFY_INT32_INT32_BITS(cksum_field_handle, 0)
-
-    debug("       : Updating packet checksum (offload)\n");
-    // TODO implement offload
+    struct uint8_buffer_s span = { .buffer = (uint8_t*)pd->data + len_l2, .buffer_size = len_l3 };
+    if (can_offload_ipv4_csum16(span, pd)) {
+        offload_ipv4_csum16(span, cksum_field_handle, SHORT_STDPARAMS_IN);
+    } else {
+        write_csum16(calculate_csum16_inplace(NULL, 0, span, cksum_field_handle, false, pd), cksum_field_handle, SHORT_STDPARAMS_IN);
+    }
 }
 
 void mark_to_drop(SHORT_STDPARAMS) {
@@ -132,13 +362,3 @@ void verify(bool check, enum error_error toSignal, SHORT_STDPARAMS) {
     // TODO implement call to extern
     debug("    : Called extern " T4LIT(verify,extern) "\n");
 }
-
-void verify_checksum_with_payload(bool condition, struct uint8_buffer_s data, bitfield_handle_t checksum, enum enum_HashAlgorithm algo, SHORT_STDPARAMS) {
-    // TODO implement call to extern
-    debug("    : Called extern " T4LIT(verify_checksum_with_payload,extern) "\n");
-}
-
-void update_checksum_with_payload(bool condition, struct uint8_buffer_s data, bitfield_handle_t checksum, enum enum_HashAlgorithm algo, SHORT_STDPARAMS) {
-    // TODO implement call to extern
-    debug("    : Called extern " T4LIT(update_checksum_with_payload,extern) "\n");
-}
@@ -161,6 +161,8 @@ void flush_table(lookup_table_t* t)
             ternary_flush(t);
             break;
     }
+
+    t->entry.entry_count = 0;
 }
 
 void table_set_default_action(lookup_table_t* t, uint8_t* entry)
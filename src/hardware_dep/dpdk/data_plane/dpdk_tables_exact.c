@@ -58,6 +58,7 @@ void exact_add(lookup_table_t* t, uint8_t* key, uint8_t* value)
     if (t->entry.key_size == 0) return; // don't add lines to keyless tables
 
     extended_table_t* ext = (extended_table_t*)t->table;
+    bool is_new_key = rte_hash_lookup(ext->rte_table, key) < 0;
     uint32_t index = rte_hash_add_key(ext->rte_table, (void*) key);
 
     if (unlikely((int32_t)index < 0)) {
@@ -66,18 +67,41 @@ void exact_add(lookup_table_t* t, uint8_t* key, uint8_t* value)
     }
 
     ext->content[index%t->max_size] = make_table_entry_on_socket(t, value);
+    if (is_new_key)    ++t->entry.entry_count;
 
     // dbg_bytes(key, t->entry.key_size, "   :: Add " T4LIT(exact) " entry to " T4LIT(%s,table) " (hash " T4LIT(%d) "): " T4LIT(%s,action) " <- ", t->name, index, get_entry_action_name(value));
 }
 
+// Replaces a part of the entry that belongs to the key; the rest of the entry is kept.
+// If there is no such entry yet, the rest of the new entry is zeroed.
+void exact_add_part(lookup_table_t* t, uint8_t* key, int offset, uint8_t* value, int size)
+{
+    if (t->entry.key_size == 0) return; // don't add lines to keyless tables
+
+    extended_table_t* ext = (extended_table_t*)t->table;
+    uint8_t entry[t->entry.action_size];
+    int32_t ret = rte_hash_lookup(ext->rte_table, key);
+    if (ret >= 0) {
+        memcpy(entry, ext->content[ret%t->max_size], t->entry.action_size);
+    } else {
+        memset(entry, 0, t->entry.action_size);
+    }
+    memcpy(entry + offset, value, size);
+
+    exact_add(t, key, entry);
+}
+
 void exact_delete(lookup_table_t* t, uint8_t* key)
 {
     if (t->entry.key_size == 0) return; // nothing must have been added
 
     extended_table_t* ext = (extended_table_t*)t->table;
-    int32_t ret = rte_hash_lookup(ext->rte_table, key);
-    if (ret >= 0)
+    int32_t ret = rte_hash_del_key(ext->rte_table, key);
+    if (ret >= 0) {
         rte_free(ext->content[ret%t->max_size]);
+        ext->content[ret%t->max_size] = NULL;
+        --t->entry.entry_count;
+    }
 }
 
 uint8_t* exact_lookup(lookup_table_t* t, uint8_t* key)
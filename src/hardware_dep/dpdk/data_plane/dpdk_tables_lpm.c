@@ -82,6 +82,7 @@ void lpm_add(lookup_table_t* t, uint8_t* key, uint8_t depth, uint8_t* value)
 
     extended_table_t* ext = (extended_table_t*)t->table;
     ext->content[ext->size] = make_table_entry_on_socket(t, value);
+    ++t->entry.entry_count;
     if (t->entry.key_size <= 4)
     {
         // the rest is zeroed in case of keys smaller than 4 bytes
@@ -27,6 +27,7 @@ void ternary_add(lookup_table_t* t, uint8_t* key, uint8_t* mask, uint8_t* value)
 
     uint8_t* entry = make_table_entry_on_socket(t, value);
     naive_ternary_add(t->table, key, mask, entry);
+    ++t->entry.entry_count;
 }
 
 uint8_t* ternary_lookup(lookup_table_t* t, uint8_t* key)
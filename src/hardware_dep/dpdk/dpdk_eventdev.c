@@ -0,0 +1,360 @@
+// Copyright 2018 Eotvos Lorand University, Budapest, Hungary
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <rte_eventdev.h>
+#include <rte_service.h>
+
+#include "dpdk_lib.h"
+#include "util.h"
+#include "dpdk_nicon.h"
+
+extern struct lcore_conf lcore_conf[RTE_MAX_LCORE];
+
+extern struct lcore_data init_lcore_data();
+extern void main_loop_pre_rx(struct lcore_data* lcdata);
+extern void main_loop_post_rx(struct lcore_data* lcdata);
+extern void main_loop_rx_group(struct lcore_data* lcdata, unsigned queue_idx);
+extern unsigned get_queue_count(struct lcore_data* lcdata);
+extern void send_single_packet(struct lcore_data* lcdata, packet_descriptor_t* pd, packet* pkt, int egress_port, int ingress_port, bool send_clone);
+
+extern void init_parser_state(parser_state_t*);
+extern void handle_packet(packet_descriptor_t* pd, lookup_table_t** tables, parser_state_t* pstate, uint32_t portid);
+extern void do_single_tx(struct lcore_data* lcdata, packet_descriptor_t* pd, unsigned queue_idx, unsigned pkt_idx);
+
+// ------------------------------------------------------
+// Locals
+
+uint8_t  eventdev_id;
+uint32_t eventdev_service_id;
+bool     eventdev_has_service = false;
+
+enum eventdev_role_e eventdev_roles[RTE_MAX_LCORE];
+uint8_t              eventdev_ports[RTE_MAX_LCORE];
+
+// ------------------------------------------------------
+// Setup
+
+enum eventdev_role_e get_eventdev_role(unsigned lcore_id) {
+    return eventdev_roles[lcore_id];
+}
+
+uint8_t get_eventdev_port(unsigned lcore_id) {
+    return eventdev_ports[lcore_id];
+}
+
+// The lcores with RX queues receive, the first one of the rest sends,
+// and the others become workers.
+static uint8_t assign_eventdev_roles()
+{
+    uint8_t nb_ports = 0;
+    unsigned nb_workers = 0;
+    bool has_tx = false;
+
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (rte_lcore_is_enabled(lcore_id) == 0)   continue;
+
+        enum eventdev_role_e role = lcore_conf[lcore_id].hw.n_rx_queue != 0 ? EVENTDEV_ROLE_RX
+                                  : !has_tx                                  ? EVENTDEV_ROLE_TX
+                                                                             : EVENTDEV_ROLE_WORKER;
+        has_tx     |= role == EVENTDEV_ROLE_TX;
+        nb_workers += role == EVENTDEV_ROLE_WORKER;
+
+        eventdev_roles[lcore_id] = role;
+        eventdev_ports[lcore_id] = nb_ports++;
+
+        debug("   :: lcore " T4LIT(%d,core) " is an event " T4LIT(%s) " on event port " T4LIT(%d) "\n", lcore_id,
+              role == EVENTDEV_ROLE_RX ? "RX core" : role == EVENTDEV_ROLE_TX ? "TX core" : "worker",
+              eventdev_ports[lcore_id]);
+    }
+
+    if (nb_workers == 0) {
+        rte_exit(EXIT_FAILURE, "The eventdev pipeline needs at least two lcores without RX queues (one TX lcore and at least one worker)\n");
+    }
+
+    return nb_ports;
+}
+
+static void setup_eventdev_queue(uint8_t queue_id)
+{
+    struct rte_event_queue_conf queue_conf;
+    rte_event_queue_default_conf_get(eventdev_id, queue_id, &queue_conf);
+    queue_conf.schedule_type   = RTE_SCHED_TYPE_ATOMIC;
+    queue_conf.nb_atomic_flows = EVENTDEV_FLOW_COUNT;
+
+    if (rte_event_queue_setup(eventdev_id, queue_id, &queue_conf) < 0)
+        rte_exit(EXIT_FAILURE, "Cannot set up event queue %d\n", queue_id);
+}
+
+static void setup_eventdev_port(unsigned lcore_id)
+{
+    uint8_t port_id = eventdev_ports[lcore_id];
+
+    struct rte_event_port_conf port_conf;
+    rte_event_port_default_conf_get(eventdev_id, port_id, &port_conf);
+    port_conf.dequeue_depth = RTE_MIN(port_conf.dequeue_depth, MAX_PKT_BURST);
+    port_conf.enqueue_depth = RTE_MIN(port_conf.enqueue_depth, MAX_PKT_BURST);
+
+    if (rte_event_port_setup(eventdev_id, port_id, &port_conf) < 0)
+        rte_exit(EXIT_FAILURE, "Cannot set up event port %d for lcore %u\n", port_id, lcore_id);
+
+    // the RX lcores only enqueue, so their ports are not linked to any queue
+    enum eventdev_role_e role = eventdev_roles[lcore_id];
+    if (role == EVENTDEV_ROLE_RX)    return;
+
+    uint8_t queue_id = role == EVENTDEV_ROLE_WORKER ? EVENTDEV_QUEUE_WORKERS : EVENTDEV_QUEUE_TX;
+    if (rte_event_port_link(eventdev_id, port_id, &queue_id, NULL, 1) != 1)
+        rte_exit(EXIT_FAILURE, "Cannot link event port %d to queue %d\n", port_id, queue_id);
+}
+
+void init_eventdev()
+{
+    int dev_id = rte_event_dev_get_dev_id(T4P4S_EVENTDEV_NAME);
+    if (dev_id < 0)
+        rte_exit(EXIT_FAILURE, "Event device " T4P4S_EVENTDEV_NAME " not found, it has to be created with --vdev=" T4P4S_EVENTDEV_NAME "\n");
+    eventdev_id = dev_id;
+
+    uint8_t nb_ports = assign_eventdev_roles();
+
+    struct rte_event_dev_info info;
+    rte_event_dev_info_get(eventdev_id, &info);
+
+    struct rte_event_dev_config conf = {
+        .nb_event_queues             = 2,
+        .nb_event_ports              = nb_ports,
+        .nb_events_limit             = info.max_num_events,
+        .nb_event_queue_flows        = RTE_MIN(EVENTDEV_FLOW_COUNT, info.max_event_queue_flows),
+        .nb_event_port_dequeue_depth = RTE_MIN(MAX_PKT_BURST, info.max_event_port_dequeue_depth),
+        .nb_event_port_enqueue_depth = RTE_MIN(MAX_PKT_BURST, info.max_event_port_enqueue_depth),
+        .dequeue_timeout_ns          = info.min_dequeue_timeout_ns,
+    };
+
+    if (rte_event_dev_configure(eventdev_id, &conf) < 0)
+        rte_exit(EXIT_FAILURE, "Cannot configure event device " T4P4S_EVENTDEV_NAME "\n");
+
+    setup_eventdev_queue(EVENTDEV_QUEUE_WORKERS);
+    setup_eventdev_queue(EVENTDEV_QUEUE_TX);
+
+    for (unsigned lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+        if (eventdev_roles[lcore_id] == EVENTDEV_ROLE_NONE)    continue;
+        setup_eventdev_port(lcore_id);
+    }
+
+    // event_sw0 has no hardware scheduler, the TX lcore runs its scheduler service
+    eventdev_has_service = rte_event_dev_service_id_get(eventdev_id, &eventdev_service_id) == 0;
+    if (eventdev_has_service) {
+        rte_service_runstate_set(eventdev_service_id, 1);
+        rte_service_set_runstate_mapped_check(eventdev_service_id, 0);
+    }
+
+    if (rte_event_dev_start(eventdev_id) < 0)
+        rte_exit(EXIT_FAILURE, "Cannot start event device " T4P4S_EVENTDEV_NAME "\n");
+}
+
+// ------------------------------------------------------
+// RX stage
+
+static void eventdev_rx_loop(struct lcore_data* lcdata)
+{
+    struct rte_event events[MAX_PKT_BURST];
+
+    while (true) {
+        main_loop_pre_rx(lcdata);
+
+        unsigned queue_count = get_queue_count(lcdata);
+        for (unsigned queue_idx = 0; queue_idx < queue_count; queue_idx++) {
+            main_loop_rx_group(lcdata, queue_idx);
+
+            unsigned nb_rx = lcdata->nb_rx;
+            for (unsigned i = 0; i < nb_rx; i++) {
+                struct rte_mbuf* mbuf = lcdata->pkts_burst[i];
+#ifdef T4P4S_LATENCY
+                MBUF_RX_TSC(mbuf) = lcdata->rx_tsc;
+#endif
+
+                events[i] = (struct rte_event) {
+                    .flow_id    = mbuf->ol_flags & PKT_RX_RSS_HASH ? mbuf->hash.rss : mbuf->port,
+                    .op         = RTE_EVENT_OP_NEW,
+                    .sched_type = RTE_SCHED_TYPE_ATOMIC,
+                    .queue_id   = EVENTDEV_QUEUE_WORKERS,
+                    .event_type = RTE_EVENT_TYPE_ETHDEV,
+                    .mbuf       = mbuf,
+                };
+            }
+
+            // if the workers cannot keep up, the packets are dropped here, as the NIC would drop them
+            uint16_t nb_enq = rte_event_enqueue_new_burst(eventdev_id, lcdata->event_port_id, events, nb_rx);
+            for (unsigned i = nb_enq; i < nb_rx; i++) {
+                rte_pktmbuf_free(events[i].mbuf);
+            }
+#ifdef T4P4S_STATS
+            lcdata->conf->hw.stats.event_drops += nb_rx - nb_enq;
+#endif
+        }
+    }
+}
+
+// ------------------------------------------------------
+// Worker stage
+
+// The replicas of multicast packets are new events,
+// which the device does not accept above its new event threshold.
+// As the RX lcores may keep the device at the threshold, the worker does not wait for it indefinitely:
+// the replicas that are not accepted after a few tries are dropped.
+static void eventdev_flush_replicas(struct lcore_data* lcdata)
+{
+    uint16_t nb_enq = 0;
+    for (int retry = 0; nb_enq < lcdata->nb_tx_events && retry < EVENTDEV_ENQUEUE_RETRIES; retry++) {
+        nb_enq += rte_event_enqueue_new_burst(eventdev_id, lcdata->event_port_id, lcdata->tx_events + nb_enq, lcdata->nb_tx_events - nb_enq);
+    }
+    for (unsigned i = nb_enq; i < lcdata->nb_tx_events; i++) {
+        rte_pktmbuf_free(lcdata->tx_events[i].mbuf);
+    }
+#ifdef T4P4S_STATS
+    lcdata->conf->hw.stats.event_drops += lcdata->nb_tx_events - nb_enq;
+#endif
+    lcdata->nb_tx_events = 0;
+}
+
+// Called instead of sending the packet on the worker lcores.
+// The egress port is carried in the sub event type.
+// The packet goes on in the event it was dequeued in,
+// only the further replicas of a multicast packet need new events.
+void eventdev_send_to_tx(struct lcore_data* lcdata, struct rte_mbuf* mbuf, uint8_t egress_port)
+{
+    struct rte_event* event = lcdata->event;
+    if (likely(event != NULL)) {
+        event->op             = RTE_EVENT_OP_FORWARD;
+        event->queue_id       = EVENTDEV_QUEUE_TX;
+        event->event_type     = RTE_EVENT_TYPE_CPU;
+        event->sub_event_type = egress_port;
+        event->mbuf           = mbuf;
+        lcdata->event = NULL;
+        return;
+    }
+
+    lcdata->tx_events[lcdata->nb_tx_events++] = (struct rte_event) {
+        .flow_id        = lcdata->event_flow_id,
+        .op             = RTE_EVENT_OP_NEW,
+        .sched_type     = RTE_SCHED_TYPE_ATOMIC,
+        .queue_id       = EVENTDEV_QUEUE_TX,
+        .event_type     = RTE_EVENT_TYPE_CPU,
+        .sub_event_type = egress_port,
+        .mbuf           = mbuf,
+    };
+
+    if (unlikely(lcdata->nb_tx_events == MAX_PKT_BURST))    eventdev_flush_replicas(lcdata);
+}
+
+// Each dequeued event is either forwarded to the TX stage or released (if its packet is dropped),
+// which also releases the atomic context of its flow.
+// Forwarded and released events are not limited by the new event threshold,
+// so the device accepts them as soon as it has room, and they are retried until then.
+// The forwarded events keep their order, so the next packets of a flow cannot overtake them.
+static void eventdev_forward_to_tx(struct lcore_data* lcdata, struct rte_event* events, uint16_t nb_events)
+{
+    struct rte_event releases[MAX_PKT_BURST];
+    uint16_t nb_fwd = 0, nb_rel = 0;
+    for (unsigned i = 0; i < nb_events; i++) {
+        if (events[i].op == RTE_EVENT_OP_FORWARD)    events[nb_fwd++] = events[i];
+        else                                         releases[nb_rel++] = events[i];
+    }
+
+    uint16_t nb_enq = 0;
+    while (nb_enq < nb_fwd) {
+        nb_enq += rte_event_enqueue_forward_burst(eventdev_id, lcdata->event_port_id, events + nb_enq, nb_fwd - nb_enq);
+    }
+
+    nb_enq = 0;
+    while (nb_enq < nb_rel) {
+        nb_enq += rte_event_enqueue_burst(eventdev_id, lcdata->event_port_id, releases + nb_enq, nb_rel - nb_enq);
+    }
+}
+
+static void eventdev_worker_loop(struct lcore_data* lcdata)
+{
+    struct rte_event events[MAX_PKT_BURST];
+
+    packet_descriptor_t pd;
+    init_dataplane(&pd, lcdata->conf->state.tables);
+
+    while (true) {
+        uint16_t nb_deq = rte_event_dequeue_burst(eventdev_id, lcdata->event_port_id, events, MAX_PKT_BURST, 0);
+
+        for (unsigned i = 0; i < nb_deq; i++) {
+            pd.wrapper = events[i].mbuf;
+            pd.data    = rte_pktmbuf_mtod(events[i].mbuf, uint8_t*);
+            lcdata->event         = &events[i];
+            lcdata->event_flow_id = events[i].flow_id;
+
+            init_parser_state(&(lcdata->conf->state.parser_state));
+            handle_packet(&pd, lcdata->conf->state.tables, &(lcdata->conf->state.parser_state), events[i].mbuf->port);
+            do_single_tx(lcdata, &pd, 0, i);
+
+            // the packet was dropped
+            if (lcdata->event != NULL)    events[i].op = RTE_EVENT_OP_RELEASE;
+        }
+
+        eventdev_forward_to_tx(lcdata, events, nb_deq);
+        if (lcdata->nb_tx_events != 0)    eventdev_flush_replicas(lcdata);
+
+#ifdef T4P4S_STATS
+        lcdata->conf->hw.stats.events += nb_deq;
+#endif
+    }
+}
+
+// ------------------------------------------------------
+// TX stage
+
+static void eventdev_tx_loop(struct lcore_data* lcdata)
+{
+    struct rte_event events[MAX_PKT_BURST];
+
+    while (true) {
+        if (eventdev_has_service) {
+            rte_service_run_iter_on_app_lcore(eventdev_service_id, 1);
+        }
+
+        main_loop_pre_rx(lcdata);
+
+        uint16_t nb_deq = rte_event_dequeue_burst(eventdev_id, lcdata->event_port_id, events, MAX_PKT_BURST, 0);
+        for (unsigned i = 0; i < nb_deq; i++) {
+            send_single_packet(lcdata, NULL, events[i].mbuf, events[i].sub_event_type, events[i].mbuf->port, false);
+        }
+
+        // as in run-to-completion mode, the buffered packets are sent if there are no more to wait for
+        lcdata->rx_burst_was_full = nb_deq == MAX_PKT_BURST;
+        main_loop_post_rx(lcdata);
+    }
+}
+
+// ------------------------------------------------------
+
+bool eventdev_main_loop()
+{
+    struct lcore_data lcdata = init_lcore_data();
+    if (!lcdata.is_valid) {
+        debug("lcore data is invalid, exiting\n");
+        return false;
+    }
+
+    switch (lcdata.eventdev_role) {
+        case EVENTDEV_ROLE_RX:      eventdev_rx_loop(&lcdata);      break;
+        case EVENTDEV_ROLE_WORKER:  eventdev_worker_loop(&lcdata);  break;
+        case EVENTDEV_ROLE_TX:      eventdev_tx_loop(&lcdata);      break;
+        default:                                                    break;
+    }
+
+    return lcdata.is_valid;
+}
@@ -400,9 +400,16 @@ unsigned get_queue_count(struct lcore_data* lcdata) {
     return 1;
 }
 
+// The packets are only checked, never sent, so the replicas can share the original.
+packet* replicate_packet(struct lcore_data* lcdata, packet_descriptor_t* pd) {
+    return pd->wrapper;
+}
+
+// The expected egress port of a replicated packet is the one that the pipeline set
+// (e.g. T4P4S_BROADCAST_PORT), not the port of the replica.
 void send_single_packet(struct lcore_data* lcdata, packet_descriptor_t* pd, packet* pkt, int egress_port, int ingress_port, bool send_clone) {
     struct rte_mbuf* mbuf = (struct rte_mbuf *)pkt;
-    check_sent_packet(lcdata, pd, egress_port, ingress_port);
+    check_sent_packet(lcdata, pd, extract_egress_port(pd), ingress_port);
 }
 
 bool storage_already_inited = false;
@@ -23,6 +23,7 @@ extern int get_socketid(unsigned lcore_id);
 extern struct lcore_conf lcore_conf[RTE_MAX_LCORE];
 extern void dpdk_init_nic();
 extern uint8_t get_nb_ports();
+extern uint32_t enabled_port_mask;
 
 // ------------------------------------------------------
 // Locals
@@ -34,35 +35,145 @@ struct rte_mbuf* deparse_mbuf;
 
 // ------------------------------------------------------
 
+// Sends the packets to the NIC and returns how many it has accepted.
+static inline uint16_t tx_burst(struct lcore_conf *conf, uint8_t port, struct rte_mbuf **pkts, uint16_t n)
+{
+#ifdef T4P4S_LATENCY
+    // the mbufs may be freed by the driver once they are sent
+    uint64_t rx_tscs[MAX_PKT_BURST];
+    for (int i = 0; i < n; i++) {
+        rx_tscs[i] = MBUF_RX_TSC(pkts[i]);
+    }
+#endif
+
+    uint16_t ret = rte_eth_tx_burst(port, conf->hw.tx_queue_id[port], pkts, n);
+
+#ifdef T4P4S_LATENCY
+    uint64_t tx_tsc = rte_rdtsc();
+    for (int i = 0; i < ret; i++) {
+        if (likely(rx_tscs[i] != 0))    latency_record(&conf->hw.latency, tx_tsc - rx_tscs[i]);
+    }
+#endif
+#ifdef T4P4S_STATS
+    conf->hw.stats.tx_packets += ret;
+#endif
+
+    return ret;
+}
+
+// Puts a packet that the NIC did not accept into the backlog of the port.
+// If the backlog is full, either the new packet (default)
+// or the oldest one in the backlog (T4P4S_TX_DROP_OLDEST) is dropped.
+// The ports that are not enabled have no backlog, their packets are dropped.
+static void tx_backlog_push(struct lcore_data* lcdata, uint8_t port, struct rte_mbuf* mbuf)
+{
+    struct tx_backlog* backlog = lcdata->tx_backlog[port];
+
+    if (unlikely(backlog == NULL)) {
+#ifdef T4P4S_STATS
+        ++lcdata->conf->hw.stats.tx_drops;
+#endif
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    if (unlikely(backlog->count == T4P4S_TX_BACKLOG_SIZE)) {
+#ifdef T4P4S_STATS
+        ++lcdata->conf->hw.stats.tx_drops;
+#endif
+#ifdef T4P4S_TX_DROP_OLDEST
+        rte_pktmbuf_free(backlog->pkts[backlog->head]);
+        backlog->head = (backlog->head + 1) % T4P4S_TX_BACKLOG_SIZE;
+        --backlog->count;
+#else
+        rte_pktmbuf_free(mbuf);
+        return;
+#endif
+    }
+
+    backlog->pkts[(backlog->head + backlog->count) % T4P4S_TX_BACKLOG_SIZE] = mbuf;
+    ++backlog->count;
+    lcdata->tx_backlog_ports |= 1U << port;
+#ifdef T4P4S_STATS
+    ++lcdata->conf->hw.stats.tx_backlogged;
+#endif
+}
+
+// Sends as much of the backlog of the port as the NIC accepts.
+// Returns true if the backlog became empty.
+static bool tx_backlog_retry(struct lcore_data* lcdata, uint8_t port)
+{
+    struct tx_backlog* backlog = lcdata->tx_backlog[port];
+
+    while (backlog->count != 0) {
+        // the stored packets may wrap around the end of the ring
+        uint16_t n = RTE_MIN(backlog->count, T4P4S_TX_BACKLOG_SIZE - backlog->head);
+        n = RTE_MIN(n, MAX_PKT_BURST);
+
+        uint16_t ret = tx_burst(lcdata->conf, port, &backlog->pkts[backlog->head], n);
+        backlog->head = (backlog->head + ret) % T4P4S_TX_BACKLOG_SIZE;
+        backlog->count -= ret;
+
+        if (ret < n)    return false;
+    }
+
+    lcdata->tx_backlog_ports &= ~(1U << port);
+    return true;
+}
+
+// Retries sending the backlogs that the NIC did not accept earlier.
+static void tx_backlog_retry_all(struct lcore_data* lcdata)
+{
+    uint32_t ports = lcdata->tx_backlog_ports;
+    while (ports != 0) {
+        unsigned portid = __builtin_ctz(ports);
+        ports &= ports - 1;
+
+        tx_backlog_retry(lcdata, (uint8_t) portid);
+    }
+}
+
 /* Send burst of packets on an output interface */
-static inline void send_burst(struct lcore_conf *conf, uint16_t n, uint8_t port)
+static inline void send_burst(struct lcore_data* lcdata, uint16_t n, uint8_t port)
 {
-    uint16_t queueid = conf->hw.tx_queue_id[port];
-    struct rte_mbuf **m_table = (struct rte_mbuf **)conf->hw.tx_mbufs[port].m_table;
-
-    int ret = rte_eth_tx_burst(port, queueid, m_table, n);
-    if (unlikely(ret < n)) {
-        do {
-            rte_pktmbuf_free(m_table[ret]);
-        } while (++ret < n);
+    struct rte_mbuf **m_table = (struct rte_mbuf **)lcdata->conf->hw.tx_mbufs[port].m_table;
+
+    // the backlogged packets go first to keep the order of the packets
+    bool is_backlog_empty = (lcdata->tx_backlog_ports & (1U << port)) == 0 || tx_backlog_retry(lcdata, port);
+    uint16_t ret = is_backlog_empty ? tx_burst(lcdata->conf, port, m_table, n) : 0;
+
+    for (; ret < n; ++ret) {
+        tx_backlog_push(lcdata, port, m_table[ret]);
+    }
+}
+
+static void tx_flush_pending(struct lcore_data* lcdata) {
+    uint32_t pending = lcdata->tx_pending_ports;
+    while (pending != 0) {
+        unsigned portid = __builtin_ctz(pending);
+        pending &= pending - 1;
+
+        send_burst(lcdata,
+                   lcdata->conf->hw.tx_mbufs[portid].len,
+                   (uint8_t) portid);
+        lcdata->conf->hw.tx_mbufs[portid].len = 0;
     }
+
+    lcdata->tx_pending_ports = 0;
 }
 
+// The partially filled TX buffers are flushed as soon as an RX round
+// does not fill a whole burst (see main_loop_post_rx), as then there is
+// no more traffic to wait for. Under full load, the packets are sent
+// in full bursts, and the rest is drained every BURST_TX_DRAIN_US.
 void tx_burst_queue_drain(struct lcore_data* lcdata) {
+    if (likely(lcdata->tx_pending_ports == 0))    return;
+
     uint64_t cur_tsc = rte_rdtsc();
 
     uint64_t diff_tsc = cur_tsc - lcdata->prev_tsc;
     if (unlikely(diff_tsc > lcdata->drain_tsc)) {
-        for (unsigned portid = 0; portid < get_nb_ports(); portid++) {
-            if (lcdata->conf->hw.tx_mbufs[portid].len == 0)
-                continue;
-
-            send_burst(lcdata->conf,
-                       lcdata->conf->hw.tx_mbufs[portid].len,
-                       (uint8_t) portid);
-            lcdata->conf->hw.tx_mbufs[portid].len = 0;
-        }
-
+        tx_flush_pending(lcdata);
         lcdata->prev_tsc = cur_tsc;
     }
 }
@@ -81,60 +192,82 @@ add_packet_to_queue(struct rte_mbuf *mbuf, uint8_t port, uint32_t lcore_id)
 }
 
 
-/* creating replicas of a packet for  */
-static inline struct rte_mbuf *
-mcast_out_pkt(struct rte_mbuf *pkt, int use_clone)
+extern bool multi_seg_tx_offload;
+extern packet* clone_packet(packet* pd, struct rte_mempool* mempool);
+
+// Creates a replica of the packet for multicast/broadcast.
+// The headers are copied into a private segment from header_pool
+// so that they can be rewritten per port, and the payload is shared
+// with the original packet by an indirect mbuf from clone_pool.
+packet* replicate_packet(struct lcore_data* lcdata, packet_descriptor_t* pd)
 {
-    struct rte_mbuf *hdr;
+    struct rte_mbuf* pkt = (struct rte_mbuf*)pd->wrapper;
 
-    debug("mcast_out_pkt new mbuf is needed...\n");
-        /* Create new mbuf for the header. */
-        if ((hdr = rte_pktmbuf_alloc(header_pool)) == NULL)
-                return (NULL);
+    if (unlikely(!multi_seg_tx_offload)) {
+        return clone_packet(pkt, lcdata->mempool);
+    }
 
-    debug("hdr is allocated\n");
+    struct rte_mbuf* hdr = rte_pktmbuf_alloc(header_pool);
+    if (unlikely(hdr == NULL))    return NULL;
 
-    /* If requested, then make a new clone packet. */
-    if (use_clone != 0 &&
-        (pkt = rte_pktmbuf_clone(pkt, clone_pool)) == NULL) {
-            rte_pktmbuf_free(hdr);
-            return (NULL);
-    }
+    uint16_t hdr_len = pd->is_emit_reordering ? pd->emit_headers_length : pd->parsed_length;
+    hdr_len = RTE_MIN(hdr_len, rte_pktmbuf_data_len(pkt));
+    hdr_len = RTE_MIN(hdr_len, rte_pktmbuf_tailroom(hdr));
 
-    debug("setup ne header\n");
+    rte_memcpy(rte_pktmbuf_append(hdr, hdr_len), rte_pktmbuf_mtod(pkt, uint8_t*), hdr_len);
 
-    /* prepend new header */
-    hdr->next = pkt;
+    if (likely(rte_pktmbuf_pkt_len(pkt) > hdr_len)) {
+        struct rte_mbuf* payload = rte_pktmbuf_clone(pkt, clone_pool);
+        if (unlikely(payload == NULL)) {
+            rte_pktmbuf_free(hdr);
+            return NULL;
+        }
 
+        rte_pktmbuf_adj(payload, hdr_len);
 
-    /* update header's fields */
-    hdr->pkt_len = (uint16_t)(hdr->data_len + pkt->pkt_len);
-    hdr->nb_segs = (uint8_t)(pkt->nb_segs + 1);
+        hdr->next     = payload;
+        hdr->nb_segs  = payload->nb_segs + 1;
+        hdr->pkt_len += payload->pkt_len;
+    }
 
-    /* copy metadata from source packet*/
-    hdr->port = pkt->port;
-    hdr->vlan_tci = pkt->vlan_tci;
+    hdr->port       = pkt->port;
+    hdr->vlan_tci   = pkt->vlan_tci;
     hdr->vlan_tci_outer = pkt->vlan_tci_outer;
     hdr->tx_offload = pkt->tx_offload;
-    hdr->hash = pkt->hash;
-
-    hdr->ol_flags = pkt->ol_flags;
+    hdr->hash       = pkt->hash;
+    hdr->ol_flags   = pkt->ol_flags;
+#ifdef T4P4S_LATENCY
+    MBUF_RX_TSC(hdr) = MBUF_RX_TSC(pkt);
+#endif
 
     __rte_mbuf_sanity_check(hdr, 1);
-    return (hdr);
+    return hdr;
 }
 
 // ------------------------------------------------------
 
-static void dpdk_send_packet(struct rte_mbuf *mbuf, uint8_t port, uint32_t lcore_id)
+static void dpdk_send_packet(struct lcore_data* lcdata, struct rte_mbuf *mbuf, uint8_t port, uint32_t lcore_id)
 {
     struct lcore_conf *conf = &lcore_conf[lcore_id];
+
+    if (unlikely(port >= TX_PORT_MASK_BITS)) {
+        debug("    " T4LIT(!!,warning) " Egress port " T4LIT(%d,port) " cannot be enabled, " T4LIT(dropping,status) " packet\n", port);
+        rte_pktmbuf_free(mbuf);
+#ifdef T4P4S_STATS
+        ++conf->hw.stats.tx_drops;
+#endif
+        return;
+    }
+
     uint16_t queue_length = add_packet_to_queue(mbuf, port, lcore_id);
 
     if (unlikely(queue_length == MAX_PKT_BURST)) {
         debug("    :: BURST SENDING DPDK PACKETS - port:%d\n", port);
-        send_burst(conf, MAX_PKT_BURST, port);
+        send_burst(lcdata, MAX_PKT_BURST, port);
         queue_length = 0;
+        lcdata->tx_pending_ports &= ~(1U << port);
+    } else {
+        lcdata->tx_pending_ports |= 1U << port;
     }
 
     conf->hw.tx_mbufs[port].len = queue_length;
@@ -146,9 +279,109 @@ void send_single_packet(struct lcore_data* lcdata, packet_descriptor_t* pd, pack
     uint32_t lcore_id = rte_lcore_id();
     struct rte_mbuf* mbuf = (struct rte_mbuf *)pkt;
 
-    dpdk_send_packet(mbuf, egress_port, lcore_id);
+#ifdef T4P4S_EVENTDEV
+    if (lcdata->eventdev_role == EVENTDEV_ROLE_WORKER) {
+        eventdev_send_to_tx(lcdata, mbuf, egress_port);
+        return;
+    }
+#endif
+
+    dpdk_send_packet(lcdata, mbuf, egress_port, lcore_id);
+}
+
+// ------------------------------------------------------
+// Power saving
+
+#ifdef T4P4S_POWER
+
+// Registers the RX queues of the lcore for interrupts in the epoll instance of its thread.
+// The queues cannot follow a rebalanced queue, so rebalancing only uses the sleeps.
+static bool init_rx_intr(struct lcore_data* lcdata)
+{
+#ifdef T4P4S_REBALANCE
+    return false;
+#else
+    for (unsigned i = 0; i < lcdata->conf->hw.n_rx_queue; i++) {
+        struct lcore_rx_queue* queue = &lcdata->conf->hw.rx_queue_list[i];
+        void* data = (void*)(uintptr_t)((queue->port_id << 8) | queue->queue_id);
+        if (rte_eth_dev_rx_intr_ctl_q(queue->port_id, queue->queue_id, RTE_EPOLL_PER_THREAD, RTE_INTR_EVENT_ADD, data) != 0) {
+            RTE_LOG(INFO, P4_FWD, "lcore %u: no RX interrupts on port %u queue %u, it will only sleep when idle\n", rte_lcore_id(), queue->port_id, queue->queue_id);
+            return false;
+        }
+    }
+    return lcdata->conf->hw.n_rx_queue != 0;
+#endif
+}
+
+static void set_rx_intr(struct lcore_data* lcdata, bool is_on)
+{
+    for (unsigned i = 0; i < lcdata->conf->hw.n_rx_queue; i++) {
+        struct lcore_rx_queue* queue = &lcdata->conf->hw.rx_queue_list[i];
+        if (is_on)    rte_eth_dev_rx_intr_enable(queue->port_id, queue->queue_id);
+        else          rte_eth_dev_rx_intr_disable(queue->port_id, queue->queue_id);
+    }
+}
+
+// Waits until a packet arrives on any of the RX queues of the lcore, or the timeout expires.
+static void wait_for_rx_intr(struct lcore_data* lcdata)
+{
+    struct rte_epoll_event events[MAX_RX_QUEUE_PER_LCORE];
+
+    set_rx_intr(lcdata, true);
+    // a packet that arrived before enabling the interrupts would not wake the lcore up
+    bool has_packets = false;
+    for (unsigned i = 0; i < lcdata->conf->hw.n_rx_queue && !has_packets; i++) {
+        struct lcore_rx_queue* queue = &lcdata->conf->hw.rx_queue_list[i];
+        has_packets = rte_eth_rx_queue_count(queue->port_id, queue->queue_id) > 0;
+    }
+
+    if (!has_packets) {
+        rte_epoll_wait(RTE_EPOLL_PER_THREAD, events, MAX_RX_QUEUE_PER_LCORE, T4P4S_POWER_INTR_TIMEOUT_MS);
+    }
+    set_rx_intr(lcdata, false);
+}
+
+// The lcore polls at full speed while there is traffic,
+// and backs off more and more as the RX rounds keep being empty.
+static void idle_back_off(struct lcore_data* lcdata)
+{
+    if (!lcdata->rx_round_was_empty) {
+        lcdata->idle_rounds = 0;
+        return;
+    }
+
+    uint32_t idle_rounds = ++lcdata->idle_rounds;
+    if (likely(idle_rounds < T4P4S_POWER_PAUSE_ROUNDS))    return;
+
+    if (idle_rounds < T4P4S_POWER_SLEEP_ROUNDS) {
+        rte_pause();
+        return;
+    }
+
+    // nothing should wait in the TX buffers while the lcore sleeps
+    if (lcdata->tx_pending_ports != 0)    tx_flush_pending(lcdata);
+
+#ifdef T4P4S_STATS
+    uint64_t sleep_start_tsc = rte_rdtsc();
+#endif
+
+    if (idle_rounds >= T4P4S_POWER_INTR_ROUNDS && lcdata->has_rx_intr && lcdata->tx_backlog_ports == 0) {
+        wait_for_rx_intr(lcdata);
+        lcdata->idle_rounds = T4P4S_POWER_SLEEP_ROUNDS;
+#ifdef T4P4S_STATS
+        ++lcdata->conf->hw.stats.intr_wakeups;
+#endif
+    } else {
+        rte_delay_us_sleep(RTE_MIN(idle_rounds - T4P4S_POWER_SLEEP_ROUNDS + 1, T4P4S_POWER_MAX_SLEEP_US));
+    }
+
+#ifdef T4P4S_STATS
+    lcdata->conf->hw.stats.sleep_cycles += rte_rdtsc() - sleep_start_tsc;
+#endif
 }
 
+#endif
+
 // ------------------------------------------------------
 
 void init_queues(struct lcore_data* lcdata) {
@@ -157,21 +390,50 @@ void init_queues(struct lcore_data* lcdata) {
         uint8_t queueid = lcdata->conf->hw.rx_queue_list[i].queue_id;
         RTE_LOG(INFO, P4_FWD, " -- lcoreid=%u portid=%u rxqueueid=%hhu\n", rte_lcore_id(), portid, queueid);
     }
+
+    for (unsigned portid = 0; portid < RTE_MIN(RTE_MAX_ETHPORTS, TX_PORT_MASK_BITS); portid++) {
+        if ((enabled_port_mask & (1U << portid)) == 0)    continue;
+
+        lcdata->tx_backlog[portid] = rte_zmalloc_socket("tx_backlog", sizeof(struct tx_backlog), RTE_CACHE_LINE_SIZE, get_socketid(rte_lcore_id()));
+        if (lcdata->tx_backlog[portid] == NULL)
+            rte_exit(EXIT_FAILURE, "Cannot allocate TX backlog for port %u on lcore %u\n", portid, rte_lcore_id());
+    }
+
+#ifdef T4P4S_POWER
+    lcdata->has_rx_intr = init_rx_intr(lcdata);
+#endif
 }
 
 struct lcore_data init_lcore_data() {
     struct lcore_data lcdata = {
         .drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * BURST_TX_DRAIN_US,
         .prev_tsc  = 0,
+        .tx_pending_ports  = 0,
+        .tx_backlog_ports  = 0,
+        .rx_burst_was_full = false,
 
         .conf     = &lcore_conf[rte_lcore_id()],
-        .mempool  = pktmbuf_pool[get_socketid(rte_lcore_id())], // TODO: Check for MULTI-SOCKET CASE !!!!
-
+        // the RX queues of the lcore use the pool of its socket, see dpdk_init_rx_queue;
+        // check_lcore_params warns if the ports of these queues are on another socket
+        .mempool  = pktmbuf_pool[get_socketid(rte_lcore_id())],
+
+#ifdef T4P4S_EVENTDEV
+        .eventdev_role = get_eventdev_role(rte_lcore_id()),
+        .event_port_id = get_eventdev_port(rte_lcore_id()),
+        .event         = NULL,
+        .nb_tx_events  = 0,
+
+        .is_valid  = get_eventdev_role(rte_lcore_id()) != EVENTDEV_ROLE_NONE,
+#else
         .is_valid  = lcdata.conf->hw.n_rx_queue != 0,
+#endif
     };
 
     if (lcdata.is_valid) {
         RTE_LOG(INFO, P4_FWD, "entering main loop on lcore %u\n", rte_lcore_id());
+#ifdef T4P4S_REBALANCE
+        lcdata.conf->hw.rebalance_is_active = lcdata.conf->hw.n_rx_queue != 0;
+#endif
 
         init_queues(&lcdata);
     } else {
@@ -196,6 +458,9 @@ bool receive_packet(packet_descriptor_t* pd, struct lcore_data* lcdata, unsigned
     rte_prefetch0(rte_pktmbuf_mtod(p, void *));
     pd->data = rte_pktmbuf_mtod(p, uint8_t *);
     pd->wrapper = p;
+#ifdef T4P4S_LATENCY
+    MBUF_RX_TSC(p) = lcdata->rx_tsc;
+#endif
 
     return true;
 }
@@ -222,10 +487,31 @@ void init_storage() {
 }
 
 void main_loop_pre_rx(struct lcore_data* lcdata) {
+#ifdef T4P4S_REBALANCE
+    rebalance_queues();
+    if (unlikely(rebalance_is_pending(&lcdata->conf->hw))) {
+        // the packets of the handed over queue should not overtake the ones still in the buffers
+        tx_flush_pending(lcdata);
+        rebalance_handover(rte_lcore_id());
+    }
+#endif
+    if (unlikely(lcdata->tx_backlog_ports != 0))    tx_backlog_retry_all(lcdata);
     tx_burst_queue_drain(lcdata);
+    lcdata->rx_burst_was_full = false;
+#ifdef T4P4S_POWER
+    lcdata->rx_round_was_empty = true;
+#endif
 }
 
 void main_loop_post_rx(struct lcore_data* lcdata) {
+    // if all queues were drained, waiting for more packets would only add latency
+    if (!lcdata->rx_burst_was_full && lcdata->tx_pending_ports != 0) {
+        tx_flush_pending(lcdata);
+    }
+
+#ifdef T4P4S_POWER
+    idle_back_off(lcdata);
+#endif
 }
 
 void main_loop_post_single_rx(struct lcore_data* lcdata, bool got_packet) {
@@ -238,27 +524,21 @@ uint32_t get_portid(struct lcore_data* lcdata, unsigned queue_idx) {
 void main_loop_rx_group(struct lcore_data* lcdata, unsigned queue_idx) {
     uint8_t queue_id = lcdata->conf->hw.rx_queue_list[queue_idx].queue_id;
     lcdata->nb_rx = rte_eth_rx_burst((uint8_t) get_portid(lcdata, queue_idx), queue_id, lcdata->pkts_burst, MAX_PKT_BURST);
-    /*
-    static uint64_t main_loop_count = 0;
-    main_loop_count++;
-    if (unlikely(main_loop_count % 10000000 == 0)) {
-        struct rte_eth_stats stats;
-        uint32_t port_id = 1;//get_portid(lcdata, queue_idx);
-        rte_eth_stats_get(port_id, &stats);
-        printf("-------------------- [%u for port %u]\n", main_loop_count / 10000000, port_id);
-        printf("ipackets = %u\n", stats.ipackets);
-        printf("opackets = %u\n", stats.opackets);
-        printf("ibytes = %u\n", stats.obytes);
-        printf("imissed = %u\n", stats.imissed);
-        printf("ierrors = %u\n", stats.oerrors);
-        printf("rx_nombuf = %u\n", stats.rx_nombuf);
-        printf("q_errors[0] = %u\n", stats.q_errors[0]);
-        printf("q_ipackets[0] = %u\n", stats.q_ipackets[0]);
-        printf("q_opackets[0] = %u\n", stats.q_opackets[0]);
-        printf("q_ibytes[0] = %u\n", stats.q_ibytes[0]);
-        printf("q_obytes[0] = %u\n", stats.q_obytes[0]);
-        fflush(stdout);
-    }*/
+    lcdata->rx_burst_was_full |= lcdata->nb_rx == MAX_PKT_BURST;
+#ifdef T4P4S_POWER
+    lcdata->rx_round_was_empty &= lcdata->nb_rx == 0;
+#endif
+#ifdef T4P4S_LATENCY
+    if (lcdata->nb_rx > 0)    lcdata->rx_tsc = rte_rdtsc();
+#endif
+
+    // note: the port statistics are available via telemetry (see dpdk_lib_stats.c)
+#ifdef T4P4S_STATS
+    struct lcore_stats* stats = &lcdata->conf->hw.stats;
+    ++stats->polls;
+    stats->empty_polls += lcdata->nb_rx == 0;
+    stats->rx_packets  += lcdata->nb_rx;
+#endif
 }
 
 unsigned get_pkt_count_in_group(struct lcore_data* lcdata) {
@@ -298,7 +578,6 @@ void t4p4s_post_launch(int idx) {
 
 }
 
-extern uint32_t enabled_port_mask;
 uint32_t get_port_mask() {
     return enabled_port_mask;
 }
@@ -0,0 +1,65 @@
+// Copyright 2018 Eotvos Lorand University, Budapest, Hungary
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DPDK_EVENTDEV_H
+#define DPDK_EVENTDEV_H
+
+// Pipeline execution mode (option `pipeline=eventdev`).
+// Instead of running the whole pipeline on the lcore that received the packet,
+// the lcores that have RX queues only receive the packets
+// and pass them to a software event device (event_sw0).
+// It schedules them to a pool of worker lcores that run the pipeline.
+// Both event queues are atomic on the RSS hash of the packet,
+// so the packets of a flow are processed by one worker at a time
+// and they leave in the order they arrived.
+// One more lcore sends the packets and runs the scheduler of event_sw0.
+//
+//     RX lcores --[queue 0]--> worker lcores --[queue 1]--> TX lcore
+
+#ifdef T4P4S_EVENTDEV
+
+#include <rte_eventdev.h>
+#include <rte_version.h>
+
+#if RTE_VERSION < RTE_VERSION_NUM(18,2,0,0)
+    #error The eventdev pipeline mode needs DPDK 18.02 or newer
+#endif
+
+#define T4P4S_EVENTDEV_NAME        "event_sw0"
+
+#define EVENTDEV_QUEUE_WORKERS     0
+#define EVENTDEV_QUEUE_TX          1
+
+#define EVENTDEV_FLOW_COUNT        1024
+#define EVENTDEV_ENQUEUE_RETRIES   32
+
+enum eventdev_role_e {
+    EVENTDEV_ROLE_NONE,
+    EVENTDEV_ROLE_RX,
+    EVENTDEV_ROLE_WORKER,
+    EVENTDEV_ROLE_TX,
+};
+
+struct lcore_data;
+
+void init_eventdev();
+enum eventdev_role_e get_eventdev_role(unsigned lcore_id);
+uint8_t get_eventdev_port(unsigned lcore_id);
+bool eventdev_main_loop();
+
+void eventdev_send_to_tx(struct lcore_data* lcdata, struct rte_mbuf* mbuf, uint8_t egress_port);
+
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+// Copyright 2018 Eotvos Lorand University, Budapest, Hungary
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DPDK_LATENCY_H
+#define DPDK_LATENCY_H
+
+// Latency measurement mode (option `latency`).
+// Each received mbuf is stamped with the TSC of its RX burst,
+// and when it is handed to the NIC in send_burst, its latency
+// (including the time it waited in tx_mbufs) is recorded
+// into a per-lcore log-linear histogram.
+
+#ifdef T4P4S_LATENCY
+
+#include <rte_mbuf.h>
+#include <rte_version.h>
+
+// each power of two range is split into 2^LATENCY_SUB_BUCKET_BITS linear sub-buckets,
+// so the recorded values are accurate within 1/2^LATENCY_SUB_BUCKET_BITS
+#define LATENCY_SUB_BUCKET_BITS  3
+#define LATENCY_SUB_BUCKET_COUNT (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS         40
+#define LATENCY_BUCKET_COUNT     ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKET_COUNT)
+
+typedef struct latency_histogram_s {
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t max_cycles;
+    uint64_t buckets[LATENCY_BUCKET_COUNT];
+} latency_histogram_t;
+
+#if RTE_VERSION >= RTE_VERSION_NUM(19,11,0,0)
+    extern int latency_tsc_dynfield_offset;
+    #define MBUF_RX_TSC(mbuf) (*RTE_MBUF_DYNFIELD((mbuf), latency_tsc_dynfield_offset, uint64_t*))
+#else
+    #define MBUF_RX_TSC(mbuf) ((mbuf)->udata64)
+#endif
+
+static inline int latency_bucket_idx(uint64_t cycles)
+{
+    if (cycles < LATENCY_SUB_BUCKET_COUNT)    return cycles;
+
+    int msb = 63 - __builtin_clzll(cycles);
+    if (unlikely(msb >= LATENCY_MAX_BITS))    return LATENCY_BUCKET_COUNT - 1;
+
+    int shift = msb - LATENCY_SUB_BUCKET_BITS;
+    return ((shift + 1) << LATENCY_SUB_BUCKET_BITS) + ((cycles >> shift) & (LATENCY_SUB_BUCKET_COUNT - 1));
+}
+
+// The smallest value that belongs to the bucket.
+static inline uint64_t latency_bucket_value(int idx)
+{
+    if (idx < LATENCY_SUB_BUCKET_COUNT)    return idx;
+
+    int shift = (idx >> LATENCY_SUB_BUCKET_BITS) - 1;
+    return (uint64_t)(LATENCY_SUB_BUCKET_COUNT + (idx & (LATENCY_SUB_BUCKET_COUNT - 1))) << shift;
+}
+
+static inline void latency_record(latency_histogram_t* hist, uint64_t cycles)
+{
+    ++hist->count;
+    hist->total_cycles += cycles;
+    if (unlikely(cycles > hist->max_cycles))    hist->max_cycles = cycles;
+    ++hist->buckets[latency_bucket_idx(cycles)];
+}
+
+void init_latency();
+uint64_t latency_percentile(latency_histogram_t* hist, double percentile);
+void print_latency();
+
+#endif
+
+#endif // DPDK_LATENCY_H
@@ -49,6 +49,8 @@
 #include "dpdk_tables.h"
 #include "tables.h"
 #include "ctrl_plane_backend.h"
+#include "dpdk_profile.h"
+#include "dpdk_latency.h"
 
 //=============================================================================
 // Backend-specific aliases
@@ -78,13 +80,22 @@
 #define RTE_LOGTYPE_L2FWD RTE_LOGTYPE_USER1 // rte_log.h
 #define RTE_LOGTYPE_P4_FWD RTE_LOGTYPE_USER1 // rte_log.h
 
-#define MBUF_SIZE (2048 + sizeof(struct rte_mbuf) + RTE_PKTMBUF_HEADROOM)
+#define MBUF_DATA_SIZE (2048 + RTE_PKTMBUF_HEADROOM)
+#define MBUF_SIZE      (MBUF_DATA_SIZE + sizeof(struct rte_mbuf))
 
-#define NB_MBUF 8192
+// the number of mbufs on each socket is calculated from the ports, queues and lcores (see calculate_nb_mbuf),
+// it can be overridden by --mbufs
 #define MEMPOOL_CACHE_SIZE 256
 
 #define MAX_JUMBO_PKT_LEN  9600
 
+// the most segments a received packet can take up
+#ifdef T4P4S_JUMBO
+#define MAX_SEGS_PER_PKT   ((MAX_JUMBO_PKT_LEN + MBUF_DATA_SIZE - RTE_PKTMBUF_HEADROOM - 1) / (MBUF_DATA_SIZE - RTE_PKTMBUF_HEADROOM))
+#else
+#define MAX_SEGS_PER_PKT   1
+#endif
+
 #define MBUF_TABLE_SIZE 32
 
 struct mbuf_table {
@@ -106,6 +117,9 @@ struct mbuf_table {
 struct lcore_rx_queue {
 	uint8_t port_id;
 	uint8_t queue_id;
+#ifdef T4P4S_REBALANCE
+	uint64_t busy_cycles; // spent on the non-empty bursts of the queue
+#endif
 } __rte_cache_aligned;
 
 #define NB_REPLICA 2
@@ -116,9 +130,29 @@ struct lcore_params {
     uint8_t lcore_id;
 } __rte_cache_aligned;
 
+#ifdef T4P4S_STATS
+// the duration of every (T4P4S_STATS_SAMPLE_MASK+1)th lookup is measured
+#ifndef T4P4S_STATS_SAMPLE_MASK
+#define T4P4S_STATS_SAMPLE_MASK 0x3f
+#endif
+
+// per-lcore counters of a table, aggregated on request of the control plane
+typedef struct table_stats_s {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t default_actions;
+    uint64_t sampled_lookups;
+    uint64_t sampled_cycles;
+} table_stats_t;
+#endif
+
 struct lcore_state {
     lookup_table_t* tables[NB_TABLES];
     parser_state_t parser_state;
+#ifdef T4P4S_STATS
+    table_stats_t table_stats[NB_TABLES];
+#endif
 };
 
 struct socket_state {
@@ -127,6 +161,27 @@ struct socket_state {
     int              active_replica [NB_TABLES];
 };
 
+#ifdef T4P4S_STATS
+// per-lcore counters of the main loop, exported via telemetry
+struct lcore_stats {
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t tx_drops;      // packets dropped because the TX backlog was full or the port is not enabled
+    uint64_t tx_backlogged; // packets that the NIC did not accept at first and had to wait in the TX backlog
+    uint64_t polls;
+    uint64_t empty_polls;
+    uint64_t header_segs;   // packets whose headers did not fit into the headroom and got a new first segment
+#ifdef T4P4S_POWER
+    uint64_t sleep_cycles;  // spent in back-off sleeps and waiting for RX interrupts
+    uint64_t intr_wakeups;  // waits for RX interrupts
+#endif
+#ifdef T4P4S_EVENTDEV
+    uint64_t events;        // packets processed by a worker lcore
+    uint64_t event_drops;   // packets (and multicast replicas) dropped because the event device was full
+#endif
+};
+#endif
+
 struct lcore_hardware_conf {
     // message queues
     uint64_t tx_tsc;
@@ -134,6 +189,21 @@ struct lcore_hardware_conf {
     struct lcore_rx_queue rx_queue_list[MAX_RX_QUEUE_PER_LCORE];
     uint16_t tx_queue_id[RTE_MAX_ETHPORTS];
     struct mbuf_table tx_mbufs[RTE_MAX_ETHPORTS];
+#ifdef T4P4S_STATS
+    struct lcore_stats stats;
+#endif
+#ifdef T4P4S_LATENCY
+    latency_histogram_t latency;
+#endif
+#ifdef T4P4S_REBALANCE
+    // RX queue handover, see dpdk_lib_rebalance.c
+    bool                  rebalance_is_active;
+    volatile bool         rebalance_out_ready;
+    uint16_t              rebalance_out_idx;
+    uint16_t              rebalance_out_lcore;
+    volatile bool         rebalance_in_ready;
+    struct lcore_rx_queue rebalance_in;
+#endif
 };
 
 struct lcore_conf {
@@ -142,6 +212,115 @@ struct lcore_conf {
 } __rte_cache_aligned;
 
 
+//=============================================================================
+// Statistics
+
+void get_table_counters(int tableid, struct p4_table_counters* counters);
+void init_telemetry();
+
+//=============================================================================
+// Multicast
+
+// group 0 means "no multicast", as in v1model
+#define T4P4S_MCAST_GROUP_COUNT 1024
+
+// port masks of the multicast groups, set by the control plane
+extern uint32_t mcast_group_ports[T4P4S_MCAST_GROUP_COUNT];
+
+void set_mcast_group(uint16_t mcast_grp, uint32_t port_mask);
+
+static inline uint32_t get_mcast_group_ports(uint16_t mcast_grp) {
+    return likely(mcast_grp < T4P4S_MCAST_GROUP_COUNT) ? mcast_group_ports[mcast_grp] : 0;
+}
+
+//=============================================================================
+// Multi-segment packets
+
+// Headers that do not fit into the first segment are copied into the bounce storage of the packet descriptor.
+// Returns NULL if the packet is too short for them or the storage is full, the parser rejects such packets.
+uint8_t* parser_bounce_header(packet_descriptor_t* pd, uint32_t length);
+void write_back_bounced_headers(packet_descriptor_t* pd);
+
+// Used when the headroom of the packet cannot hold the emitted headers.
+uint8_t* prepend_header_segment(packet_descriptor_t* pd, uint32_t old_headers_length, uint32_t new_headers_length);
+
+void write_packet_bytes_segmented(packet* pkt, uint32_t offset, const uint8_t* src, uint32_t length);
+
+static inline void write_packet_bytes(packet* pkt, uint32_t offset, const uint8_t* src, uint32_t length) {
+    if (likely(offset + length <= rte_pktmbuf_data_len(pkt))) {
+        memcpy(rte_pktmbuf_mtod_offset(pkt, uint8_t*, offset), src, length);
+    } else {
+        write_packet_bytes_segmented(pkt, offset, src, length);
+    }
+}
+
+//=============================================================================
+// Packet type classification
+
+#ifdef T4P4S_PTYPE
+
+// The EtherType of the outermost Ethernet header as classified by the NIC,
+// or -1 if the NIC did not classify the packet (the parser then looks at the header itself).
+static inline int ptype_ether_type(packet_descriptor_t* pd) {
+    uint32_t ptype = pd->wrapper->packet_type;
+    switch (ptype & RTE_PTYPE_L2_MASK) {
+        case RTE_PTYPE_L2_ETHER_ARP:  return 0x0806;
+        case RTE_PTYPE_L2_ETHER_LLDP: return 0x88cc;
+        case RTE_PTYPE_L2_ETHER:
+            if (RTE_ETH_IS_IPV4_HDR(ptype))                       return 0x0800;
+            if ((ptype & RTE_PTYPE_L3_MASK) == RTE_PTYPE_L3_IPV6) return 0x86dd;
+            return -1;
+        default:                      return -1;
+    }
+}
+
+// The protocol of the IPv4 header (or the next header of the IPv6 header without extension headers)
+// after the outermost Ethernet header as classified by the NIC, or -1.
+static inline int ptype_ip_proto(packet_descriptor_t* pd) {
+    uint32_t ptype = pd->wrapper->packet_type;
+    bool is_ipv6 = (ptype & RTE_PTYPE_L3_MASK) == RTE_PTYPE_L3_IPV6;
+    if ((ptype & RTE_PTYPE_L2_MASK) != RTE_PTYPE_L2_ETHER || !(RTE_ETH_IS_IPV4_HDR(ptype) || is_ipv6))    return -1;
+
+    switch (ptype & RTE_PTYPE_L4_MASK) {
+        case RTE_PTYPE_L4_TCP:  return 6;
+        case RTE_PTYPE_L4_UDP:  return 17;
+        case RTE_PTYPE_L4_SCTP: return 132;
+        case RTE_PTYPE_L4_ICMP: return is_ipv6 ? 58 : 1;
+        default:                return -1;
+    }
+}
+
+#endif
+
+//=============================================================================
+// Rebalancing
+
+#ifdef T4P4S_REBALANCE
+
+#ifndef T4P4S_REBALANCE_PERIOD_MS
+#define T4P4S_REBALANCE_PERIOD_MS           100
+#endif
+// the busiest lcore has to be at least this busy...
+#ifndef T4P4S_REBALANCE_MIN_BUSY_PERCENT
+#define T4P4S_REBALANCE_MIN_BUSY_PERCENT    50
+#endif
+// ...and this much busier than the average
+#ifndef T4P4S_REBALANCE_THRESHOLD_PERMILLE
+#define T4P4S_REBALANCE_THRESHOLD_PERMILLE  1250
+#endif
+
+extern uint64_t rebalance_moves;
+extern uint32_t rebalance_imbalance_permille;
+
+void rebalance_queues();
+void rebalance_handover(unsigned lcore_id);
+
+static inline bool rebalance_is_pending(struct lcore_hardware_conf* hw) {
+    return hw->rebalance_out_ready || hw->rebalance_in_ready;
+}
+
+#endif
+
 //=============================================================================
 // Timings
 
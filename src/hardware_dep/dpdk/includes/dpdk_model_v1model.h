@@ -26,6 +26,30 @@ void verify_checksum(bool cond, struct uint8_buffer_s data, bitfield_handle_t ck
 void update_checksum(bool cond, struct uint8_buffer_s data, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm,
                      packet_descriptor_t* pd, lookup_table_t** tables);
 
+void verify_checksum_with_payload(bool cond, struct uint8_buffer_s data, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm,
+                     packet_descriptor_t* pd, lookup_table_t** tables);
+
+void update_checksum_with_payload(bool cond, struct uint8_buffer_s data, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm,
+                     packet_descriptor_t* pd, lookup_table_t** tables);
+
+// Variants for data that is summed up in place: the values before the header span
+// and the span that contains the checksum field itself, see checksum_plan in codegen.sugar.py
+void verify_checksum_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm,
+                     packet_descriptor_t* pd, lookup_table_t** tables);
+
+void update_checksum_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm,
+                     packet_descriptor_t* pd, lookup_table_t** tables);
+
+void verify_checksum_with_payload_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm,
+                     packet_descriptor_t* pd, lookup_table_t** tables);
+
+void update_checksum_with_payload_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm,
+                     packet_descriptor_t* pd, lookup_table_t** tables);
+
+// Variant for a checksum whose changed fields are known, see checksum_changes in codegen.sugar.py
+void update_checksum_incremental(bool cond, struct uint8_buffer_s span, const csum16_value_t* changes, int change_count, bitfield_handle_t cksum_field_handle,
+                     packet_descriptor_t* pd, lookup_table_t** tables);
+
 void verify_checksum_offload(bitfield_handle_t cksum_field_handle, enum enum_HashAlgorithm algorithm,
                      packet_descriptor_t* pd, lookup_table_t** tables);
 
@@ -22,10 +22,14 @@
 #include "aliases.h"
 #include <stdbool.h>
 
+#ifdef T4P4S_EVENTDEV
+#include "dpdk_eventdev.h"
+#endif
+
 #define T4P4S_BROADCAST_PORT    100
 
 #define MAX_PKT_BURST     32  /* note: this equals to MBUF_TABLE_SIZE in dpdk_lib.h */
-#define BURST_TX_DRAIN_US 100 /* TX drain every ~100us */
+#define BURST_TX_DRAIN_US 100 /* TX drain every ~100us if the RX bursts keep being full */
 
 #define MAX_PORTS               16
 
@@ -42,19 +46,76 @@
 // note: this much space MUST be able to hold all deparsed content
 #define DEPARSE_BUFFER_SIZE     1024
 
+#ifdef T4P4S_POWER
+// after this many RX rounds without packets, the lcore starts to pause between the rounds...
+#ifndef T4P4S_POWER_PAUSE_ROUNDS
+#define T4P4S_POWER_PAUSE_ROUNDS    100
+#endif
+// ...then to sleep, for 1us longer after each empty round up to T4P4S_POWER_MAX_SLEEP_US...
+#ifndef T4P4S_POWER_SLEEP_ROUNDS
+#define T4P4S_POWER_SLEEP_ROUNDS    200
+#endif
+#ifndef T4P4S_POWER_MAX_SLEEP_US
+#define T4P4S_POWER_MAX_SLEEP_US    100
+#endif
+// ...and finally it waits for an RX interrupt (if the NIC supports them), at most for this long
+#ifndef T4P4S_POWER_INTR_ROUNDS
+#define T4P4S_POWER_INTR_ROUNDS     1000
+#endif
+#ifndef T4P4S_POWER_INTR_TIMEOUT_MS
+#define T4P4S_POWER_INTR_TIMEOUT_MS 10
+#endif
+#endif
+
+// packets that the NIC did not accept wait here, per lcore and port, until the next loop iteration
+#ifndef T4P4S_TX_BACKLOG_SIZE
+#define T4P4S_TX_BACKLOG_SIZE   512
+#endif
+
+struct tx_backlog {
+    uint16_t            head;
+    uint16_t            count;
+    struct rte_mbuf*    pkts[T4P4S_TX_BACKLOG_SIZE];
+};
+
+
+// the port masks below have one bit per port, as enabled_port_mask does;
+// the ports above them cannot be enabled, and the packets sent there are dropped
+#define TX_PORT_MASK_BITS   32
 
 struct lcore_data {
     const uint64_t      drain_tsc;
     uint64_t            prev_tsc;
+    uint32_t            tx_pending_ports; // bit i is set if tx_mbufs[i] is not empty
+    uint32_t            tx_backlog_ports; // bit i is set if tx_backlog[i] is not empty
+    bool                rx_burst_was_full;
+#ifdef T4P4S_POWER
+    bool                rx_round_was_empty;
+    uint32_t            idle_rounds;      // consecutive RX rounds without packets
+    bool                has_rx_intr;      // all RX queues of the lcore can wake it up by interrupt
+#endif
 
     struct lcore_conf*  conf;
+    struct tx_backlog*  tx_backlog[RTE_MAX_ETHPORTS];
 
     packet*             pkts_burst[MAX_PKT_BURST];
     unsigned            nb_rx;
+#ifdef T4P4S_LATENCY
+    uint64_t            rx_tsc; // when the current burst was received
+#endif
 
     bool                is_valid;
 
     struct rte_mempool* mempool;
+
+#ifdef T4P4S_EVENTDEV
+    enum eventdev_role_e eventdev_role;
+    uint8_t             event_port_id;
+    struct rte_event*   event;          // the dequeued event of the packet that the worker is processing, NULL once it is forwarded
+    uint32_t            event_flow_id;  // the flow of the packet that the worker is processing
+    struct rte_event    tx_events[MAX_PKT_BURST]; // the replicas of multicast packets
+    uint16_t            nb_tx_events;
+#endif
 };
 
 
@@ -38,6 +38,15 @@ typedef struct bitfield_handle_s {
     int      fixed_width;
 } bitfield_handle_t;
 
+// A value of at most 32 bits in the data of a 16 bit one's complement checksum, see checksum_plan in codegen.sugar.py.
+// The value is read from the field if it has one (byte_addr != NULL);
+// for a changed field, value holds the value it had at parsing.
+typedef struct csum16_value_s {
+    uint32_t          value; // host byte order
+    bitfield_handle_t field;
+    uint8_t           shift; // the value ends this many bits before the end of a 16 bit word of the data
+} csum16_value_t;
+
 #define FIELD_FIXED_WIDTH_(f) (f != header_var_width_field[field_header[f]])
 #define FIELD_FIXED_POS_(f)   (f <= header_var_width_field[field_header[f]] || header_var_width_field[field_header[f]] == -1)
 
@@ -59,6 +68,24 @@ typedef struct bitfield_handle_s {
             .fixed_width = FIELD_FIXED_WIDTH_(f), \
         })
 
+// The handle of a fixed width field at a fixed position in a packet header.
+// The generated code gives the layout of the field as constants instead of looking it up in the field tables,
+// so the macros below that get the handle are folded into straight-line loads, shifts, masks and byte swaps.
+#define fixed_handle(hdesc, byteoffset, bitoffset, bitwidth, be_mask) \
+        ((bitfield_handle_t) \
+        { \
+            .byte_addr   = ((uint8_t*)hdesc.pointer) + (byteoffset), \
+            .meta        = 0, \
+            .bitwidth    = (bitwidth), \
+            .bytewidth   = ((bitwidth) + 7) / 8, \
+            .bitcount    = (bitwidth) + (bitoffset), \
+            .bytecount   = ((bitwidth) + 7 + (bitoffset)) / 8, \
+            .bitoffset   = (bitoffset), \
+            .byteoffset  = (byteoffset), \
+            .mask        = (be_mask), \
+            .fixed_width = 1, \
+        })
+
 #define header_desc_buf(buf, w) ((header_descriptor_t) { -1, buf, -1, w })
 #define header_desc_ins(pd, h)  ((pd)->headers[h])
 
@@ -188,6 +215,69 @@ typedef struct bitfield_handle_s {
 }
 
 
+/*******************************************************************************
+   Wide fields
+*******************************************************************************/
+
+#define UINT64_BITS_MASK(bitwidth) ((bitwidth) >= 64 ? UINT64_MAX : (((uint64_t)1 << (bitwidth)) - 1))
+
+// Gets a field of at most 64 bits (in network byte order) as a number,
+// the field has to fit into 8 bytes (bitoffset + bitwidth <= 64)
+static inline uint64_t get_field_uint64(const uint8_t* addr, int bitoffset, int bitwidth) {
+    int bytecount = (bitoffset + bitwidth + 7) / 8;
+    uint64_t bytes = 0;
+    memcpy((uint8_t*)&bytes + 8 - bytecount, addr, bytecount);
+    return (rte_be_to_cpu_64(bytes) >> (bytecount * 8 - bitoffset - bitwidth)) & UINT64_BITS_MASK(bitwidth);
+}
+
+// Sets a field of at most 64 bits (in network byte order) to a number,
+// the field has to fit into 8 bytes (bitoffset + bitwidth <= 64)
+static inline void set_field_uint64(uint8_t* addr, int bitoffset, int bitwidth, uint64_t value) {
+    int bytecount = (bitoffset + bitwidth + 7) / 8;
+    int shift = bytecount * 8 - bitoffset - bitwidth;
+    uint64_t mask = UINT64_BITS_MASK(bitwidth) << shift;
+    uint64_t bytes = 0;
+    if (mask != UINT64_BITS_MASK(bytecount * 8)) {
+        memcpy((uint8_t*)&bytes + 8 - bytecount, addr, bytecount);
+    }
+    bytes = rte_cpu_to_be_64((rte_be_to_cpu_64(bytes) & ~mask) | ((value << shift) & mask));
+    memcpy(addr, (uint8_t*)&bytes + 8 - bytecount, bytecount);
+}
+
+// Copies a field of any width and position into (bitwidth+7)/8 bytes as a big endian number
+static inline void extract_field_bytes(uint8_t* dst, const uint8_t* addr, int bitoffset, int bitwidth) {
+    int bytewidth = (bitwidth + 7) / 8;
+    int srclen = (bitoffset + bitwidth + 7) / 8;
+    int shift = srclen * 8 - bitoffset - bitwidth;
+    for (int i = 0; i < bytewidth; ++i) {
+        int src_idx = srclen - 1 - i;
+        uint16_t two_bytes = addr[src_idx] | (src_idx > 0 ? addr[src_idx - 1] << 8 : 0);
+        dst[bytewidth - 1 - i] = (uint8_t)(two_bytes >> shift);
+    }
+    dst[0] &= 0xff >> (bytewidth * 8 - bitwidth);
+}
+
+#define EXTRACT_FIELD_BYTES(fd, dst) extract_field_bytes(dst, fd.byte_addr, fd.bitoffset, fd.bitwidth)
+
+// The saturating operations (|+| and |-|) on unsigned numbers of the given width
+static inline uint64_t add_sat_uint64(uint64_t a, uint64_t b, int bitwidth) {
+    uint64_t max = UINT64_BITS_MASK(bitwidth);
+    return a > max - b ? max : a + b;
+}
+
+static inline uint64_t sub_sat_uint64(uint64_t a, uint64_t b) {
+    return a > b ? a - b : 0;
+}
+
+// In P4, shifting by at least the width gives 0, in C, it is undefined
+static inline uint64_t shl_uint64(uint64_t a, uint64_t shift) {
+    return shift >= 64 ? 0 : a << shift;
+}
+
+static inline uint64_t shr_uint64(uint64_t a, uint64_t shift) {
+    return shift >= 64 ? 0 : a >> shift;
+}
+
 /*******************************************************************************
    Interface
 *******************************************************************************/
@@ -206,6 +296,14 @@ typedef struct bitfield_handle_s {
 #define EXTRACT_INT32_BITS_PACKET(pd , h, f, dst) EXTRACT_INT32_BITS(handle(header_desc_ins(pd , h), f), dst)
 #define EXTRACT_INT32_BITS_BUFFER(buf, w, f, dst) EXTRACT_INT32_BITS(handle(header_desc_buf(buf, w), f), dst)
 
+#define GET_INT32_FIXED_PACKET(pd, h, byteoffset, bitoffset, bitwidth, be_mask) GET_INT32_AUTO(fixed_handle(header_desc_ins(pd, h), byteoffset, bitoffset, bitwidth, be_mask))
+#define EXTRACT_INT32_FIXED_PACKET(pd, h, byteoffset, bitoffset, bitwidth, be_mask, dst) EXTRACT_INT32_NTOH(fixed_handle(header_desc_ins(pd, h), byteoffset, bitoffset, bitwidth, be_mask), dst)
+#define EXTRACT_INT32_BITS_FIXED_PACKET(pd, h, byteoffset, bitoffset, bitwidth, be_mask, dst) EXTRACT_INT32_BITS(fixed_handle(header_desc_ins(pd, h), byteoffset, bitoffset, bitwidth, be_mask), dst)
+
+#define EXTRACT_FIELD_BYTES_PACKET(pd , h, f, dst) EXTRACT_FIELD_BYTES(handle(header_desc_ins(pd , h), f), dst)
+
+#define GET_INT64_FIXED_PACKET(pd, h, byteoffset, bitoffset, bitwidth) get_field_uint64((uint8_t*)header_desc_ins(pd, h).pointer + (byteoffset), bitoffset, bitwidth)
+
 // modify
 
 #define MODIFY_BYTEBUF_BYTEBUF_PACKET(pd , h, f, src, srclen) MODIFY_BYTEBUF_BYTEBUF(handle(header_desc_ins(pd , h), f), src, srclen);
@@ -217,6 +315,13 @@ typedef struct bitfield_handle_s {
 #define MODIFY_INT32_INT32_BITS_PACKET(pd , h, f, value32) MODIFY_INT32_INT32_BITS(handle(header_desc_ins(pd , h), f), value32);
 #define MODIFY_INT32_INT32_BITS_BUFFER(buf, w, f, value32) MODIFY_INT32_INT32_BITS(handle(header_desc_buf(buf, w), f), value32);
 
+#define MODIFY_INT32_INT32_FIXED_PACKET(pd, h, byteoffset, bitoffset, bitwidth, be_mask, value32) { \
+    uint32_t res32; \
+    MODIFY_INT32_INT32_HTON(fixed_handle(header_desc_ins(pd, h), byteoffset, bitoffset, bitwidth, be_mask), value32) \
+}
+
+#define MODIFY_INT64_FIXED_PACKET(pd, h, byteoffset, bitoffset, bitwidth, value64) set_field_uint64((uint8_t*)header_desc_ins(pd, h).pointer + (byteoffset), bitoffset, bitwidth, value64);
+
 #define MODIFY_INT32_INT32_AUTO_BUFFER(buf, w, f, value32) MODIFY_INT32_INT32_AUTO(handle(header_desc_buf(buf, w), f), value32);
 
 
@@ -280,6 +385,7 @@ void transfer_to_egress(packet_descriptor_t* pd);
 
 int extract_egress_port(packet_descriptor_t* pd);
 int extract_ingress_port(packet_descriptor_t* pd);
+int extract_mcast_grp(packet_descriptor_t* pd);
 
 #endif // DPDK_PRIMITIVES_H
 
@@ -0,0 +1,134 @@
+// Copyright 2018 Eotvos Lorand University, Budapest, Hungary
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DPDK_PROFILE_H
+#define DPDK_PROFILE_H
+
+// Profiling build mode (option `profile`).
+// The generated code marks the parser states, controls, table applications and actions
+// with PROFILE_BEGIN/PROFILE_END. For one in every (T4P4S_PROFILE_SAMPLE_MASK+1) packets,
+// the TSC is read at these points, and the cycles spent in each point itself
+// (without the points nested in it) are accumulated per lcore.
+// The results are dumped in folded stack format (input for flamegraph.pl)
+// on SIGUSR2, on request of the control plane, and when the switch exits.
+// The first two are dumped by the control plane thread, not by the lcores.
+
+#ifdef T4P4S_PROFILE
+
+#include <signal.h>
+#include <stdbool.h>
+#include <rte_lcore.h>
+
+#include "sheep_precise_timer.h"
+#include "profile.h"
+
+#ifndef T4P4S_PROFILE_SAMPLE_MASK
+#define T4P4S_PROFILE_SAMPLE_MASK 0xff
+#endif
+
+#ifndef T4P4S_PROFILE_FILE
+#define T4P4S_PROFILE_FILE "t4p4s_profile.folded"
+#endif
+
+#define PROFILE_SIGNAL SIGUSR2
+
+// bucket i contains the measurements of [2^i, 2^(i+1)) cycles
+#define PROFILE_HISTOGRAM_SIZE 32
+
+// the generated code nests at most handle_packet > control > table > action
+#define PROFILE_MAX_DEPTH 8
+
+typedef struct profile_point_stats_s {
+    uint64_t count;
+    uint64_t self_cycles;
+    uint64_t histogram[PROFILE_HISTOGRAM_SIZE];
+} profile_point_stats_t;
+
+typedef struct profile_frame_s {
+    uint64_t start_tsc;
+    uint64_t child_cycles;
+} profile_frame_t;
+
+typedef struct lcore_profile_s {
+    bool     is_sampled;
+    uint32_t packet_count;
+    int      depth;
+    profile_frame_t       frames[PROFILE_MAX_DEPTH];
+    profile_point_stats_t points[NB_PROFILE_POINTS];
+} __rte_cache_aligned lcore_profile_t;
+
+extern lcore_profile_t lcore_profile[RTE_MAX_LCORE];
+
+static inline void profile_packet_start(lcore_profile_t* prof)
+{
+    prof->is_sampled = (prof->packet_count++ & T4P4S_PROFILE_SAMPLE_MASK) == 0;
+    prof->depth = 0;
+}
+
+static inline void profile_begin(lcore_profile_t* prof)
+{
+    profile_frame_t* frame = &prof->frames[prof->depth++];
+    frame->child_cycles = 0;
+    frame->start_tsc = read_rdtsc();
+}
+
+static inline void profile_end(lcore_profile_t* prof, int point)
+{
+    profile_frame_t* frame = &prof->frames[--prof->depth];
+    uint64_t cycles = read_rdtsc() - frame->start_tsc;
+    uint64_t self_cycles = cycles - frame->child_cycles;
+
+    profile_point_stats_t* stats = &prof->points[point];
+    ++stats->count;
+    stats->self_cycles += self_cycles;
+
+    int bucket = 63 - __builtin_clzll(self_cycles | 1);
+    ++stats->histogram[bucket < PROFILE_HISTOGRAM_SIZE ? bucket : PROFILE_HISTOGRAM_SIZE - 1];
+
+    if (prof->depth > 0) {
+        prof->frames[prof->depth - 1].child_cycles += cycles;
+    }
+}
+
+#define PROFILE_PACKET_START() \
+    do { profile_packet_start(&lcore_profile[rte_lcore_id()]); } while (0)
+
+#define PROFILE_BEGIN(point) \
+    do { \
+        lcore_profile_t* prof = &lcore_profile[rte_lcore_id()]; \
+        if (unlikely(prof->is_sampled))    profile_begin(prof); \
+    } while (0)
+
+#define PROFILE_END(point) \
+    do { \
+        lcore_profile_t* prof = &lcore_profile[rte_lcore_id()]; \
+        if (unlikely(prof->is_sampled))    profile_end(prof, point); \
+    } while (0)
+
+void init_profile();
+
+#else
+
+#define PROFILE_PACKET_START()
+#define PROFILE_BEGIN(point)
+#define PROFILE_END(point)
+
+#endif
+
+// Dumps the profile; it only prints a warning in non-profiling builds.
+void dump_profile();
+// Dumps the profile if SIGUSR2 was received since the last dump.
+void poll_profile_dump();
+
+#endif // DPDK_PROFILE_H
@@ -1,3 +1,6 @@
+#ifndef SHEEP_PRECISE_TIMER_H
+#define SHEEP_PRECISE_TIMER_H
+
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
 #endif /* _GNU_SOURCE */
@@ -15,15 +18,15 @@
 #include <stdio.h>
 
 static uint64_t eal_tsc_resolution_hz = 0;
-static union {
+
+/* local to the readers, as they may run on several lcores at the same time */
+typedef union {
 	uint64_t tsc_64;
 	struct {
 		uint32_t lo_32;
 		uint32_t hi_32;
 	};
-} tsc;
-static uint64_t start;
-static uint64_t end;
+} tsc_t;
 
 /* forward declaration */
 static inline uint64_t start_measurement(void);
@@ -31,7 +34,7 @@ static inline uint64_t read_rdtsc(void);
 static inline uint64_t read_rdtscp(void);
 static inline uint64_t stop_measurement(void);
 static inline void wait_cycles(uint32_t cycles);
-uint64_t rdtsc_hz(void);
+static inline uint64_t rdtsc_hz(void);
 
 /**
  * @brief Read content of TSC register with enforced serialization.
@@ -41,6 +44,7 @@ uint64_t rdtsc_hz(void);
  */
 static inline uint64_t
 start_measurement(void) {
+	tsc_t tsc;
 
 	asm volatile ("CPUID\n\t" 
 			"RDTSC\n\t" 
@@ -60,6 +64,7 @@ start_measurement(void) {
  */
 static inline uint64_t
 read_rdtsc(void) {
+	tsc_t tsc;
 
 	asm volatile("RDTSC\n\t" 
 			"mov %%edx, %0\n\t" 
@@ -79,6 +84,7 @@ read_rdtsc(void) {
  */
 static inline uint64_t
 read_rdtscp(void) {
+	tsc_t tsc;
 
 	asm volatile("RDTSCP\n\t"
 			"mov %%edx, %0\n\t" 
@@ -98,6 +104,7 @@ read_rdtscp(void) {
  */
 static inline uint64_t
 stop_measurement(void) {
+	tsc_t tsc;
 
 	asm volatile("RDTSCP\n\t" 
 			"mov %%edx, %0\n\t" 
@@ -133,7 +140,7 @@ wait_cycles(uint32_t cycles) {
  *
  * @return Ticks per second of TSC.
  */
-uint64_t
+static inline uint64_t
 rdtsc_hz(void)
 {
 	if (likely(eal_tsc_resolution_hz != 0)) {
@@ -165,3 +172,5 @@ rdtsc_hz(void)
 	}
 	return eal_tsc_resolution_hz;
 }
+
+#endif // SHEEP_PRECISE_TIMER_H
@@ -84,7 +84,7 @@ extern unsigned get_queue_count(struct lcore_data* lcdata);
 extern void send_single_packet(struct lcore_data* lcdata, packet_descriptor_t* pd, packet* pkt, int egress_port, int ingress_port);
 extern void send_broadcast_packet(struct lcore_data* lcdata, packet_descriptor_t* pd, int egress_port, int ingress_port);
 extern struct lcore_data init_lcore_data();
-extern packet* clone_packet(packet* pd, struct rte_mempool* mempool);
+extern packet* replicate_packet(struct lcore_data* lcdata, packet_descriptor_t* pd);
 extern void init_parser_state(parser_state_t*);
 
 //=============================================================================
@@ -113,29 +113,41 @@ void get_broadcast_port_msg(char result[256], int ingress_port) {
 }
 
 
-void broadcast_packet(struct lcore_data* lcdata, packet_descriptor_t* pd, int egress_port, int ingress_port)
+// Sends the packet out on all ports of the mask.
+// The last port gets the original packet, the others get replicas.
+void replicate_to_ports(struct lcore_data* lcdata, packet_descriptor_t* pd, uint32_t port_mask, int ingress_port)
 {
-    uint8_t nb_ports = get_port_count();
-    uint32_t port_mask = get_port_mask();
+    if (unlikely(port_mask == 0)) {
+        debug(" " T4LIT(XXXX,status) " " T4LIT(Dropping,status) " packet: no ports to replicate to\n");
+        free_packet(pd);
+        return;
+    }
 
-    uint8_t nb_port = 0;
-    for (uint8_t portidx = 0; nb_port < nb_ports - 1 && portidx < RTE_MAX_ETHPORTS; ++portidx) {
-        if (portidx == ingress_port) {
-           continue;
-        }
+    while (port_mask != 0) {
+        int portidx = __builtin_ctz(port_mask);
+        port_mask &= port_mask - 1;
 
-        bool is_port_disabled = (port_mask & (1 << portidx)) == 0;
-        if (is_port_disabled)   continue;
-
-        packet* pkt_out = (nb_port < nb_ports) ? clone_packet(pd->wrapper, lcdata->mempool) : pd->wrapper;
-        send_single_packet(lcdata, pd, pkt_out, egress_port, ingress_port);
+        packet* pkt_out = port_mask == 0 ? pd->wrapper : replicate_packet(lcdata, pd);
+        if (unlikely(pkt_out == NULL)) {
+            debug(" " T4LIT(!!!!,error) " " T4LIT(Could not replicate,error) " packet for port " T4LIT(%d,port) "\n", portidx);
+            continue;
+        }
 
-        nb_port++;
+        send_single_packet(lcdata, pd, pkt_out, portidx, ingress_port);
     }
+}
 
-    if (unlikely(nb_port != nb_ports - 1)) {
-        debug(" " T4LIT(!!!!,error) " " T4LIT(Wrong port count,error) ": " T4LIT(%d) " ports should be present, but only " T4LIT(%d) " found\n", nb_ports, nb_port);
-    }
+void broadcast_packet(struct lcore_data* lcdata, packet_descriptor_t* pd, int egress_port, int ingress_port)
+{
+    uint32_t port_mask = get_port_mask() & ~(1U << ingress_port);
+    replicate_to_ports(lcdata, pd, port_mask, ingress_port);
+}
+
+void multicast_packet(struct lcore_data* lcdata, packet_descriptor_t* pd, uint16_t mcast_grp, int ingress_port)
+{
+    uint32_t port_mask = get_mcast_group_ports(mcast_grp);
+    debug("   " T4LIT(<<,outgoing) " " T4LIT(Multicasting,outgoing) " packet from port " T4LIT(%d,port) " to group " T4LIT(%d) " (ports " T4LIT(0x%x) ")\n", ingress_port, mcast_grp, port_mask);
+    replicate_to_ports(lcdata, pd, port_mask, ingress_port);
 }
 
 /* Enqueue a single packet, and send burst if queue is filled */
@@ -165,9 +177,15 @@ void do_single_tx(struct lcore_data* lcdata, packet_descriptor_t* pd, unsigned q
     } else {
         debug(" " T4LIT(<<<<,outgoing) " " T4LIT(Egressing,outgoing) " packet\n");
 
-        int egress_port = extract_egress_port(pd);
         int ingress_port = extract_ingress_port(pd);
 
+        uint16_t mcast_grp = extract_mcast_grp(pd);
+        if (unlikely(mcast_grp != 0)) {
+            multicast_packet(lcdata, pd, mcast_grp, ingress_port);
+            return;
+        }
+
+        int egress_port = extract_egress_port(pd);
         send_packet(lcdata, pd, egress_port, ingress_port);
     }
 }
@@ -191,12 +209,22 @@ void do_rx(struct lcore_data* lcdata, packet_descriptor_t* pd)
 {
     unsigned queue_count = get_queue_count(lcdata);
     for (unsigned queue_idx = 0; queue_idx < queue_count; queue_idx++) {
+        #ifdef T4P4S_REBALANCE
+            uint64_t queue_start_tsc = rte_rdtsc();
+        #endif
+
         main_loop_rx_group(lcdata, queue_idx);
 
         unsigned pkt_count = get_pkt_count_in_group(lcdata);
         for (unsigned pkt_idx = 0; pkt_idx < pkt_count; pkt_idx++) {
             do_single_rx(lcdata, pd, queue_idx, pkt_idx);
         }
+
+        #ifdef T4P4S_REBALANCE
+            if (pkt_count > 0) {
+                lcdata->conf->hw.rx_queue_list[queue_idx].busy_cycles += rte_rdtsc() - queue_start_tsc;
+            }
+        #endif
     }
 }
 
@@ -234,7 +262,11 @@ bool dpdk_main_loop()
 static int
 launch_one_lcore(__attribute__((unused)) void *dummy)
 {
+#ifdef T4P4S_EVENTDEV
+    bool success = eventdev_main_loop();
+#else
     bool success = dpdk_main_loop();
+#endif
     return success ? 0 : -1;
 }
 
@@ -303,6 +335,22 @@ int main(int argc, char** argv)
     initialize_args(argc, argv);
     initialize_nic();
 
+    #ifdef T4P4S_EVENTDEV
+        init_eventdev();
+    #endif
+
+    #ifdef T4P4S_PROFILE
+        init_profile();
+    #endif
+
+    #ifdef T4P4S_LATENCY
+        init_latency();
+    #endif
+
+    #if defined(T4P4S_STATS) || defined(T4P4S_LATENCY) || defined(T4P4S_REBALANCE)
+        init_telemetry();
+    #endif
+
     int launch_count2 = launch_count();
     for (int i = 0; i < launch_count2; ++i) {
         debug("Initializing execution\n");
@@ -330,5 +378,13 @@ int main(int argc, char** argv)
     /*print_rte_xstats(1);
     print_rte_xstats(2);*/
 
+    #ifdef T4P4S_PROFILE
+        dump_profile();
+    #endif
+
+    #ifdef T4P4S_LATENCY
+        print_latency();
+    #endif
+
     return t4p4s_normal_exit();
 }
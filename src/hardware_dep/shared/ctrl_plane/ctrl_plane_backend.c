@@ -35,6 +35,9 @@
 
 #define CTRL_INIT_TIMEOUT  10000
 
+/* the poll callback is called at least this often */
+#define P4_BG_POLL_INTERVAL_SEC 1
+
 #define MIN(x,y) (((x) < (y)) ? (x) : (y))
 
 typedef struct mem_cell_s {
@@ -60,6 +63,7 @@ typedef struct backend_st {
     fifo_t input_queue; /* one queue per controller should be needed */
     fifo_t output_queue; /* one queue per digest-receiver should be needed */
     p4_msg_callback cb;
+    p4_poll_callback poll_cb;
 } backend_t;
 
 mem_cell_t* touch_mem_cell(backend_t* bgt);
@@ -79,12 +83,13 @@ void backend_processor(void* bg)
 
     while (1)
     {
-        tv.tv_sec = 5;
+        tv.tv_sec = P4_BG_POLL_INTERVAL_SEC;
         tv.tv_usec = 0;
         rfs = master;
         rv = select(bgt->controller_sock+1, &rfs, 0, 0, &tv);
         
         if (bgt->shutdown==1) break;
+        if (bgt->poll_cb != 0) bgt->poll_cb();
         if (rv==0) continue; /* timeout */
 
         if (FD_ISSET(bgt->controller_sock, &rfs))
@@ -229,10 +234,17 @@ ctrl_plane_backend create_backend(int num_of_threads, int queue_size, char* cont
     bg->controller_addr.sin_port = htons(controller_port);
 
     bg->cb = cb;
+    bg->poll_cb = 0;
 
     return (ctrl_plane_backend) bg;
 }
 
+void set_backend_poll_callback(ctrl_plane_backend bg, p4_poll_callback poll_cb)
+{
+    backend_t *bgt = (backend_t*) bg;
+    bgt->poll_cb = poll_cb;
+}
+
 void launch_backend(ctrl_plane_backend bg)
 {
     backend_t *bgt = (backend_t*) bg;
@@ -350,6 +362,29 @@ int send_digest(ctrl_plane_backend bg, ctrl_plane_digest d, uint32_t receiver_id
     return 0;
 }
 
+int send_table_counters(ctrl_plane_backend bg, struct p4_table_counters* counters, uint32_t xid)
+{
+    backend_t* bgt = (backend_t*)bg;
+    mem_cell_t* mem_cell = touch_mem_cell(bgt);
+    if (unlikely(mem_cell == 0))
+    {
+        fprintf(stderr, "Out of memory pool - memcell cannot be assigned to a new table counters message!\n");
+        return -1;
+    }
+
+    create_p4_header(mem_cell->data, 0, mem_cell->length);
+    struct p4_table_counters* msg = create_p4_table_counters(mem_cell->data, 0, mem_cell->length);
+    memcpy(msg->table_name, counters->table_name, sizeof(struct p4_table_counters) - sizeof(struct p4_header));
+    msg->header.xid = xid;
+
+    netconv_p4_header(&(msg->header));
+    netconv_p4_table_counters(msg);
+    if (fifo_add_msg(&(bgt->output_queue), mem_cell)==0)
+        return -1;
+
+    return 0;
+}
+
 ctrl_plane_digest create_digest(ctrl_plane_backend bg, char* name)
 {
     backend_t* bgt = (backend_t*) bg;
@@ -20,10 +20,14 @@
 typedef void* ctrl_plane_backend;
 typedef void* ctrl_plane_digest;
 
+/* called periodically from the thread that receives the controller's messages */
+typedef void (*p4_poll_callback)();
 
 ctrl_plane_backend create_backend(int num_of_threads, int queue_size, char* controller_name, int controller_port, p4_msg_callback cb);
 void destroy_backend(ctrl_plane_backend bg);
 int send_digest(ctrl_plane_backend bg, ctrl_plane_digest d, uint32_t receiver_id);
+int send_table_counters(ctrl_plane_backend bg, struct p4_table_counters* counters, uint32_t xid);
+void set_backend_poll_callback(ctrl_plane_backend bg, p4_poll_callback poll_cb);
 void launch_backend(ctrl_plane_backend bg);
 void stop_backend(ctrl_plane_backend bg);
 
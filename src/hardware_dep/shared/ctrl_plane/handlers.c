@@ -50,6 +50,17 @@ int handle_p4_msg(char* buffer, int length, p4_msg_callback cb)
 			if (rval<0) return rval;
 			cb(&ctrl_m);
 			break;
+		case P4T_GET_TABLE_COUNTERS:
+			rval = handle_p4_get_table_counters(netconv_p4_get_table_counters((struct p4_get_table_counters*)buffer), &ctrl_m);
+			if (rval<0) return rval;
+			cb(&ctrl_m);
+			break;
+		case P4T_SET_MCAST_GROUP:
+			rval = handle_p4_set_mcast_group(netconv_p4_set_mcast_group((struct p4_set_mcast_group*)buffer), &ctrl_m);
+			if (rval<0) return rval;
+			cb(&ctrl_m);
+			break;
+		case P4T_DUMP_PROFILE:
 		case P4T_CTRL_INITIALIZED:
 			/* no need to inspect trailing bytes if any so just ignore it */
 			rval = handle_p4_ctrl_initialized(header, &ctrl_m);
@@ -150,3 +161,27 @@ int handle_p4_add_table_entry(struct p4_add_table_entry* m, struct p4_ctrl_msg*
 
         return 0;
 }
+
+int handle_p4_get_table_counters(struct p4_get_table_counters* m, struct p4_ctrl_msg* ctrl_m)
+{
+	if (m->header.length<sizeof(struct p4_get_table_counters))
+		return -1; /*Truncated message*/
+
+	ctrl_m->type = m->header.type;
+	ctrl_m->xid = m->header.xid;
+	m->table_name[P4_MAX_TABLE_NAME_LEN-1] = '\0';
+	ctrl_m->table_name = m->table_name;
+	return 0;
+}
+
+int handle_p4_set_mcast_group(struct p4_set_mcast_group* m, struct p4_ctrl_msg* ctrl_m)
+{
+	if (m->header.length<sizeof(struct p4_set_mcast_group))
+		return -1; /*Truncated message*/
+
+	ctrl_m->type = m->header.type;
+	ctrl_m->xid = m->header.xid;
+	ctrl_m->mcast_grp = m->mcast_grp;
+	ctrl_m->mcast_port_mask = m->port_mask;
+	return 0;
+}
@@ -29,6 +29,8 @@ struct p4_ctrl_msg {
 	struct p4_action_parameter* action_params[P4_MAX_NUMBER_OF_ACTION_PARAMETERS];
 	int num_field_matches;
 	struct p4_field_match_header* field_matches[P4_MAX_NUMBER_OF_FIELD_MATCHES];
+	uint16_t mcast_grp;
+	uint32_t mcast_port_mask;
 };
 
 typedef void (*p4_msg_callback)(struct p4_ctrl_msg*);
@@ -37,6 +39,8 @@ int handle_p4_msg(char* buffer, int length, p4_msg_callback cb);
 int handle_p4_ctrl_initialized(struct p4_header* header, struct p4_ctrl_msg* ctrl_m);
 int handle_p4_set_default_action(struct p4_set_default_action* m, struct p4_ctrl_msg* ctrl_m);
 int handle_p4_add_table_entry(struct p4_add_table_entry* m, struct p4_ctrl_msg* ctrl_m);
+int handle_p4_get_table_counters(struct p4_get_table_counters* m, struct p4_ctrl_msg* ctrl_m);
+int handle_p4_set_mcast_group(struct p4_set_mcast_group* m, struct p4_ctrl_msg* ctrl_m);
 
 
 #endif
@@ -14,8 +14,10 @@
 #include "messages.h"
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <endian.h>
 
 /* TODO: handle ntoh and hton !!! */
 
@@ -134,6 +136,30 @@ inline struct p4_digest_field* netconv_p4_digest_field(struct p4_digest_field* m
         return m;
 }
 
+inline struct p4_get_table_counters* netconv_p4_get_table_counters(struct p4_get_table_counters* m) {
+	return m; /*nothing to do*/
+}
+
+inline struct p4_table_counters* netconv_p4_table_counters(struct p4_table_counters* m) {
+	m->lookups = htobe64(m->lookups);
+	m->hits = htobe64(m->hits);
+	m->misses = htobe64(m->misses);
+	m->default_actions = htobe64(m->default_actions);
+	m->sampled_lookups = htobe64(m->sampled_lookups);
+	m->sampled_cycles = htobe64(m->sampled_cycles);
+	m->tsc_hz = htobe64(m->tsc_hz);
+	m->entry_count = htonl(m->entry_count);
+	m->entry_size = htonl(m->entry_size);
+	m->max_size = htonl(m->max_size);
+	return m;
+}
+
+inline struct p4_set_mcast_group* netconv_p4_set_mcast_group(struct p4_set_mcast_group* m) {
+	m->mcast_grp = htons(m->mcast_grp);
+	m->port_mask = htonl(m->port_mask);
+	return m;
+}
+
 inline struct p4_action* netconv_p4_action( struct p4_action* m) {
 	return m; /*nothing to do*/
 }
@@ -302,3 +328,45 @@ inline struct p4_digest_field* unpack_p4_digest_field(char* buffer, uint16_t off
         return (struct p4_digest_field*)(buffer + offset);
 }
 
+struct p4_get_table_counters* create_p4_get_table_counters(char* buffer, uint16_t offset, uint16_t maxlength) {
+	struct p4_get_table_counters* get_counters;
+	if (offset+sizeof(struct p4_get_table_counters) >= maxlength) return 0; /* buffer overflow */
+	get_counters = (struct p4_get_table_counters*)(buffer + offset);
+	get_counters->header.length = sizeof(struct p4_get_table_counters);
+	get_counters->header.type = P4T_GET_TABLE_COUNTERS;
+	get_counters->table_name[0] = '\0';
+	return get_counters;
+}
+
+inline struct p4_get_table_counters* unpack_p4_get_table_counters(char* buffer, uint16_t offset) {
+	return (struct p4_get_table_counters*)(buffer + offset);
+}
+
+struct p4_table_counters* create_p4_table_counters(char* buffer, uint16_t offset, uint16_t maxlength) {
+	struct p4_table_counters* counters;
+	if (offset+sizeof(struct p4_table_counters) >= maxlength) return 0; /* buffer overflow */
+	counters = (struct p4_table_counters*)(buffer + offset);
+	memset((char*)counters + sizeof(struct p4_header), 0, sizeof(struct p4_table_counters) - sizeof(struct p4_header));
+	counters->header.length = sizeof(struct p4_table_counters);
+	counters->header.type = P4T_GET_TABLE_COUNTERS;
+	return counters;
+}
+
+inline struct p4_table_counters* unpack_p4_table_counters(char* buffer, uint16_t offset) {
+	return (struct p4_table_counters*)(buffer + offset);
+}
+
+struct p4_set_mcast_group* create_p4_set_mcast_group(char* buffer, uint16_t offset, uint16_t maxlength) {
+	struct p4_set_mcast_group* set_mcast_group;
+	if (offset+sizeof(struct p4_set_mcast_group) >= maxlength) return 0; /* buffer overflow */
+	set_mcast_group = (struct p4_set_mcast_group*)(buffer + offset);
+	set_mcast_group->header.length = sizeof(struct p4_set_mcast_group);
+	set_mcast_group->header.type = P4T_SET_MCAST_GROUP;
+	set_mcast_group->mcast_grp = 0;
+	set_mcast_group->port_mask = 0;
+	return set_mcast_group;
+}
+
+inline struct p4_set_mcast_group* unpack_p4_set_mcast_group(char* buffer, uint16_t offset) {
+	return (struct p4_set_mcast_group*)(buffer + offset);
+}
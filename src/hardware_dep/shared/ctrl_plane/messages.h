@@ -53,7 +53,13 @@ enum p4_type {
 	P4T_REMOVE_AP_MEMBER = 109,
 
 	/* Digest passed */
-	P4T_DIGEST = 110
+	P4T_DIGEST = 110,
+
+	/* Diagnostics */
+	P4T_DUMP_PROFILE = 111, /* header only; the switch writes its profile if compiled with profiling */
+
+	/* Packet replication */
+	P4T_SET_MCAST_GROUP = 112
 };
 
 struct p4_hello {
@@ -233,6 +239,33 @@ struct p4_digest {
 	/* struct p4_digest_field field_list[list_size]; */
 };
 
+struct p4_get_table_counters {
+	struct p4_header header;
+	char table_name[P4_MAX_TABLE_NAME_LEN]; /* empty name: all tables */
+};
+
+/* Reply to P4T_GET_TABLE_COUNTERS, one message per table */
+struct p4_table_counters {
+	struct p4_header header;
+	char table_name[P4_MAX_TABLE_NAME_LEN];
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t default_actions;
+	uint64_t sampled_lookups;
+	uint64_t sampled_cycles; /* total duration of the sampled lookups */
+	uint64_t tsc_hz; /* for converting cycles to time */
+	uint32_t entry_count;
+	uint32_t entry_size; /* in bytes */
+	uint32_t max_size;
+};
+
+struct p4_set_mcast_group {
+	struct p4_header header;
+	uint16_t mcast_grp; /* the group id; 0 means no multicast */
+	uint32_t port_mask; /* bit i is set if the group contains port i; 0 deletes the group */
+};
+
 struct p4_header *create_p4_header(char* buffer, uint16_t offset, uint16_t maxlength);
 struct p4_header *unpack_p4_header(char* buffer, uint16_t offset);
 void check_p4_header( struct p4_header* a, struct p4_header* b);
@@ -261,6 +294,12 @@ struct p4_digest* create_p4_digest(char* buffer, uint16_t offset, uint16_t maxle
 struct p4_digest* unpack_p4_digest(char* buffer, uint16_t offset);
 struct p4_digest_field* add_p4_digest_field(struct p4_digest* digest, uint16_t maxlength);
 struct p4_digest_field* unpack_p4_digest_field(char* buffer, uint16_t offset);
+struct p4_get_table_counters* create_p4_get_table_counters(char* buffer, uint16_t offset, uint16_t maxlength);
+struct p4_get_table_counters* unpack_p4_get_table_counters(char* buffer, uint16_t offset);
+struct p4_table_counters* create_p4_table_counters(char* buffer, uint16_t offset, uint16_t maxlength);
+struct p4_table_counters* unpack_p4_table_counters(char* buffer, uint16_t offset);
+struct p4_set_mcast_group* create_p4_set_mcast_group(char* buffer, uint16_t offset, uint16_t maxlength);
+struct p4_set_mcast_group* unpack_p4_set_mcast_group(char* buffer, uint16_t offset);
 
 struct p4_field_match_lpm* netconv_p4_field_match_lpm(struct p4_field_match_lpm* m);
 struct p4_field_match_exact* netconv_p4_field_match_exact(struct p4_field_match_exact* m);
@@ -273,5 +312,8 @@ struct p4_action_parameter* netconv_p4_action_parameter(struct p4_action_paramet
 struct p4_set_default_action* netconv_p4_set_default_action(struct p4_set_default_action* m);
 struct p4_field_match_header* netconv_p4_field_match_complex(struct p4_field_match_header *m, int* size);
 struct p4_add_table_entry* netconv_p4_add_table_entry(struct p4_add_table_entry* m);
+struct p4_get_table_counters* netconv_p4_get_table_counters(struct p4_get_table_counters* m);
+struct p4_table_counters* netconv_p4_table_counters(struct p4_table_counters* m);
+struct p4_set_mcast_group* netconv_p4_set_mcast_group(struct p4_set_mcast_group* m);
 
 #endif
@@ -95,6 +95,72 @@ void test_p4_set_default_action()
 
 }
 
+void test_p4_set_mcast_group()
+{
+	char buffer[BUFFLEN];
+	struct p4_set_mcast_group* smg;
+	struct p4_set_mcast_group* smg2;
+	struct p4_ctrl_msg ctrl_m;
+
+	smg = create_p4_set_mcast_group(buffer, 0, BUFFLEN);
+	smg->header.xid = 112224;
+	smg->mcast_grp = 7;
+	smg->port_mask = 0x0b;
+
+	assert(smg->header.length == sizeof(struct p4_set_mcast_group));
+	assert(smg->header.type == P4T_SET_MCAST_GROUP);
+
+	smg2 = unpack_p4_set_mcast_group(buffer, 0);
+
+	/* Testing the handler */
+
+	assert(handle_p4_set_mcast_group(smg2, &ctrl_m) == 0);
+
+	assert(ctrl_m.type == P4T_SET_MCAST_GROUP);
+	assert(ctrl_m.xid == 112224);
+	assert(ctrl_m.mcast_grp == 7);
+	assert(ctrl_m.mcast_port_mask == 0x0b);
+
+	smg2->header.length = sizeof(struct p4_header);
+	assert(handle_p4_set_mcast_group(smg2, &ctrl_m) == -1);
+}
+
+void test_p4_table_counters()
+{
+	char buffer[BUFFLEN];
+	struct p4_table_counters* tc;
+	struct p4_table_counters* tc2;
+
+	tc = create_p4_table_counters(buffer, 0, BUFFLEN);
+	tc->header.xid = 112225;
+	strcpy(tc->table_name, "smac");
+	tc->lookups = 0x0102030405060708ULL;
+	tc->hits = 1000;
+	tc->misses = 24;
+	tc->tsc_hz = 2400000000ULL;
+	tc->entry_count = 0x0a0b0c0d;
+	tc->max_size = 65536;
+
+	assert(tc->header.length == sizeof(struct p4_table_counters));
+	assert(tc->header.type == P4T_GET_TABLE_COUNTERS);
+	assert(tc->default_actions == 0 && tc->sampled_lookups == 0 && tc->sampled_cycles == 0 && tc->entry_size == 0);
+
+	/* the counters are sent in network byte order */
+	netconv_p4_table_counters(tc);
+	assert(((uint8_t*)&tc->lookups)[0] == 0x01 && ((uint8_t*)&tc->lookups)[7] == 0x08);
+	assert(((uint8_t*)&tc->entry_count)[0] == 0x0a && ((uint8_t*)&tc->entry_count)[3] == 0x0d);
+
+	tc2 = netconv_p4_table_counters(unpack_p4_table_counters(buffer, 0));
+
+	assert(strcmp(tc2->table_name, "smac") == 0);
+	assert(tc2->lookups == 0x0102030405060708ULL);
+	assert(tc2->hits == 1000);
+	assert(tc2->misses == 24);
+	assert(tc2->tsc_hz == 2400000000ULL);
+	assert(tc2->entry_count == 0x0a0b0c0d);
+	assert(tc2->max_size == 65536);
+}
+
 
 int main()
 {
@@ -110,5 +176,15 @@ int main()
 	test_p4_set_default_action();
         printf(" OK\n");
 
+	printf("* test_p4_set_mcast_group");
+	fflush(stdout);
+	test_p4_set_mcast_group();
+	printf(" OK\n");
+
+	printf("* test_p4_table_counters");
+	fflush(stdout);
+	test_p4_table_counters();
+	printf(" OK\n");
+
 	return 0;
 }
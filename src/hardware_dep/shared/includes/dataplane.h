@@ -38,7 +38,7 @@ struct type_field_list {
 };
 
 typedef struct lookup_table_entry_info_s {
-    int entry_count;
+    uint32_t entry_count;
 
     uint8_t key_size;
 
@@ -120,9 +120,18 @@ typedef struct header_descriptor_s {
     char*               name;
 } header_descriptor_t;
 
+// Header validity is kept in a bitmap, so that it can be reset with a few stores per packet;
+// the pointers of invalid headers are not cleared.
+#define HEADER_VALID_WORD_COUNT ((HEADER_INSTANCE_COUNT + 1 + 63) / 64)
+
+#define is_header_valid(pd, h)    ((((pd)->header_valid[(h) / 64]) >> ((h) % 64)) & 1)
+#define set_header_valid(pd, h)   ((pd)->header_valid[(h) / 64] |=  ((uint64_t)1 << ((h) % 64)))
+#define set_header_invalid(pd, h) ((pd)->header_valid[(h) / 64] &= ~((uint64_t)1 << ((h) % 64)))
+
 typedef struct packet_descriptor_s {
     packet_data_t*      data;
     header_descriptor_t headers[HEADER_INSTANCE_COUNT+1];
+    uint64_t            header_valid[HEADER_VALID_WORD_COUNT];
     parsed_fields_t     fields;
     packet*             wrapper;
 
@@ -134,6 +143,14 @@ typedef struct packet_descriptor_s {
     // note: it is possible to emit a header more than once; +8 is a reasonable upper limit for emits
     int header_reorder[HEADER_INSTANCE_COUNT+8];
     uint8_t header_tmp_storage[HEADER_INSTANCE_TOTAL_LENGTH];
+    // the parser can point headers into the packet up to here (the end of the first segment)
+    uint8_t* parse_end;
+    // the headers after parse_end are copied here, and written back into the segments on emit
+    uint8_t header_bounce_storage[HEADER_INSTANCE_TOTAL_LENGTH];
+    int bounce_offset; // the offset of header_bounce_storage[0] in the packet
+    int bounce_length;
+    // the IPv4 header whose checksum is calculated by the NIC, or NULL
+    uint8_t* ipv4_cksum_offload_hdr;
 
     void * control_locals;
 } packet_descriptor_t;
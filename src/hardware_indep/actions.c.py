@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 from utils.misc import addError, addWarning 
-from utils.codegen import format_declaration, format_statement, format_expr, format_type, type_env
+from utils.codegen import format_declaration, format_statement, format_expr, format_type, type_env, checksum_externs
 
 #[ #include "dpdk_lib.h"
 #[ #include "actions.h"
@@ -49,7 +49,7 @@ for m in hlir16.objects['Method']:
     # TODO temporary fix for l3-routing-full, this will be computed later on
     with types({
         "T": "struct uint8_buffer_s",
-        "O": "unsigned",
+        "O": "unsigned" if m.name not in checksum_externs else "bitfield_handle_t",
         "HashAlgorithm": "int",
     }):
         t = m.type
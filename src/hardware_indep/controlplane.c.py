@@ -20,6 +20,7 @@ def match_type_order(t):
     }
     return match_types[t]
 
+#[ #include <stddef.h>
 #[ #include <unistd.h>
 
 #[ #include "dpdk_lib.h"
@@ -30,6 +31,7 @@ def match_type_order(t):
 #[ extern void exact_add_promote  (int tableid, uint8_t* key, uint8_t* value);
 #[ extern void lpm_add_promote    (int tableid, uint8_t* key, uint8_t depth, uint8_t* value);
 #[ extern void ternary_add_promote(int tableid, uint8_t* key, uint8_t* mask, uint8_t* value);
+#[ extern void exact_add_part_promote(int tableid, uint8_t* key, int offset, uint8_t* value, int size);
 
 
 for table in hlir16.tables:
@@ -115,6 +117,11 @@ for table in hlir16_tables_with_keys:
     if table.match_type == "EXACT":
         #[ exact_add_promote(TABLE_${table.name}, (uint8_t*)key, (uint8_t*)&action);
 
+    if table.get_attr('fused_into') is not None:
+        # the entry is also stored in its part of the merged table's entry
+        #[ table_entry_${table.name}_t fused_part = { .action = action, .is_entry_valid = VALID_TABLE_ENTRY };
+        #[ exact_add_part_promote(TABLE_fused_${table.fused_into}, (uint8_t*)key, offsetof(struct fused_${table.fused_into}_action, ${table.name}), (uint8_t*)&fused_part, sizeof(fused_part));
+
     if table.match_type == "TERNARY":
         #[ ternary_add_promote(TABLE_${table.name}, (uint8_t*)key, (uint8_t*)mymask, (uint8_t*)&action);
 
@@ -237,11 +244,38 @@ for table in hlir16_tables_with_keys:
 #} }
 
 
+table_names = ", ".join(["\"T4LIT(" + table.name + ",table)\"" for table in hlir16.tables])
+
+#[ extern ctrl_plane_backend bg;
+#{ void ctrl_get_table_counters(struct p4_ctrl_msg* ctrl_m) {
+#[     bool is_all_tables = ctrl_m->table_name[0] == '\0';
+#[     bool is_found = false;
+#{     for (int tableid = 0; tableid < NB_TABLES; ++tableid) {
+#[         if (!is_all_tables && strcmp(table_config[tableid].name, ctrl_m->table_name) != 0)    continue;
+#[
+#[         struct p4_table_counters counters;
+#[         get_table_counters(tableid, &counters);
+#[         send_table_counters(bg, &counters, ctrl_m->xid);
+#[         is_found = true;
+#}     }
+#[
+#{     if (!is_found) {
+#[         debug(" $$[warning]{}{!!!! Table counters}: table name $$[warning]{}{mismatch} ($$[table]{}{%s}), expected one of ($table_names).\n", ctrl_m->table_name);
+#}     }
+#} }
+
+
 #{ void recv_from_controller(struct p4_ctrl_msg* ctrl_m) {
 #{     if (ctrl_m->type == P4T_ADD_TABLE_ENTRY) {
 #[          ctrl_add_table_entry(ctrl_m);
 #[     } else if (ctrl_m->type == P4T_SET_DEFAULT_ACTION) {
 #[         ctrl_setdefault(ctrl_m);
+#[     } else if (ctrl_m->type == P4T_GET_TABLE_COUNTERS) {
+#[         ctrl_get_table_counters(ctrl_m);
+#[     } else if (ctrl_m->type == P4T_DUMP_PROFILE) {
+#[         dump_profile();
+#[     } else if (ctrl_m->type == P4T_SET_MCAST_GROUP) {
+#[         set_mcast_group(ctrl_m->mcast_grp, ctrl_m->mcast_port_mask);
 #[     } else if (ctrl_m->type == P4T_CTRL_INITIALIZED) {
 #[         ctrl_initialized();
 #}     }
@@ -254,6 +288,7 @@ for table in hlir16_tables_with_keys:
 #[ {
 #[ #ifndef T4P4S_NO_CONTROL_PLANE
 #[     bg = create_backend(3, 1000, "localhost", 11111, recv_from_controller);
+#[     set_backend_poll_callback(bg, poll_profile_dump);
 #[     launch_backend(bg);
 #[ #endif
 #[ }
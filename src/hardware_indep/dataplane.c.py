@@ -12,7 +12,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
-from utils.codegen import format_declaration, format_statement, format_expr, format_type, type_env
+from utils.codegen import format_declaration, format_statement, format_expr, format_type, type_env, reachable_nodes, preparsed_fields_in_use, fixed_field_layout, checksum_externs
 from utils.misc import addError, addWarning
 
 #[ #include <stdlib.h>
@@ -35,6 +35,10 @@ from utils.misc import addError, addWarning
 #[ extern void increase_counter(int counterid, int index);
 #[ extern void set_handle_packet_metadata(packet_descriptor_t* pd, uint32_t portid);
 
+#[ #ifdef T4P4S_STATS
+#[ extern struct lcore_conf lcore_conf[RTE_MAX_LCORE];
+#[ #endif
+
 # note: 0 is for the special case where there are no tables
 max_key_length = max([t.key_length_bytes for t in hlir16.tables if hasattr(t, 'key')] + [0])
 #[ uint8_t reverse_buffer[${max_key_length}];
@@ -67,7 +71,8 @@ else:
 for ctl in p4_ctls:
     #[ void control_${ctl.name}(STDPARAMS);
     for t in ctl.controlLocals['P4Table']:
-        #[ struct apply_result_s ${t.name}_apply(STDPARAMS);
+        if t.get_attr('fused_into') is None:
+            #[ struct apply_result_s ${t.name}_apply(STDPARAMS);
 
 ################################################################################
 
@@ -99,15 +104,23 @@ for table in hlir16.tables:
         # fref = "field_{}_{}".format(f.header_name, f.field_name)
         fref = "field_{}_{}".format(f.header.type.type_ref.name, f.field_name)
 
-        if f.width <= 32:
+        fld = f.header.type.type_ref.fields.get(f.field_name)
+        layout = fixed_field_layout(f.header.type.type_ref, fld) if hi_name != "all_metadatas" else None
+        if f.width <= 32 and layout is not None:
+            #[ EXTRACT_INT32_BITS_FIXED_PACKET(pd, $href, $layout, *(uint32_t*)key)
+            #[ key += sizeof(uint32_t);
+        elif f.width <= 32:
             #[ EXTRACT_INT32_BITS_PACKET(pd, $href, $fref, *(uint32_t*)key)
             #[ key += sizeof(uint32_t);
-        elif f.width > 32 and f.width % 8 == 0:
+        elif f.width % 8 == 0 and fld is not None and fld.get_attr('offset') is not None and fld.offset % 8 == 0:
             byte_width = (f.width+7)/8
             #[ EXTRACT_BYTEBUF_PACKET(pd, $href, $fref, key)
             #[ key += ${byte_width};
         else:
-            addWarning("table key calculation", "Skipping unsupported field {} ({} bits): it is over 32 bits long and not byte aligned".format(f.id, f.width))
+            # the field is shifted into whole bytes
+            byte_width = (f.width+7)/8
+            #[ EXTRACT_FIELD_BYTES_PACKET(pd, $href, $fref, key)
+            #[ key += ${byte_width};
 
     if table.match_type == "LPM":
         #[ key -= ${table.key_length_bytes};
@@ -127,11 +140,37 @@ for table in hlir16.tables:
             #[ void apply_direct_smem_$type(rte_atomic32_t (*smem)[1], uint32_t value, char* table_name, char* smem_type_name, char* smem_name);
 
 
+# The fused tables get their part of the entry of the merged table from fused_apply_<first table>.
 for table in hlir16.tables:
     lookupfun = {'LPM':'lpm_lookup', 'EXACT':'exact_lookup', 'TERNARY':'ternary_lookup'}
-    #[ struct apply_result_s ${table.name}_apply(STDPARAMS)
+    is_fused = table.get_attr('fused_into') is not None
+    if is_fused:
+        #[ struct apply_result_s ${table.name}_apply_fused(STDPARAMS, table_entry_fused_${table.fused_into}_t* fused_entry)
+    else:
+        #[ struct apply_result_s ${table.name}_apply(STDPARAMS)
     #{ {
-    if hasattr(table, 'key'):
+    #[     PROFILE_BEGIN(PROFILE_table_${table.name});
+    #[ #ifdef T4P4S_STATS
+    #[     table_stats_t* stats = &lcore_conf[rte_lcore_id()].state.table_stats[TABLE_${table.name}];
+    if is_fused:
+        #[     // the lookup itself is sampled for the merged table
+        #[     ++stats->lookups;
+    else:
+        #[     bool is_sampled = (stats->lookups++ & T4P4S_STATS_SAMPLE_MASK) == 0;
+        #[     uint64_t lookup_start_tsc = unlikely(is_sampled) ? rte_rdtsc() : 0;
+    #[ #endif
+
+    if is_fused:
+        #[     table_entry_${table.name}_t* entry = fused_entry != NULL && fused_entry->action.${table.name}.is_entry_valid != INVALID_TABLE_ENTRY
+        #[                                         ? &fused_entry->action.${table.name}
+        #[                                         : (table_entry_${table.name}_t*)tables[TABLE_${table.name}]->default_val;
+        #[     bool hit = entry != NULL && entry->is_entry_valid != INVALID_TABLE_ENTRY;
+
+        #[     debug("   " T4LIT(??,table) " Lookup in $$[table]{table.name} (fused into " T4LIT(fused_${table.fused_into},table) ") $$[success]{}{%s}: $$[action]{}{%s}%s\n",
+        #[               hit ? "hit" : "miss",
+        #[               entry == NULL ? "(no action)" : action_names[entry->action.action_id],
+        #[               hit ? "" : " (default)");
+    elif hasattr(table, 'key'):
         #[     uint8_t* key[${table.key_length_bytes}];
         #[     table_${table.name}_key(pd, (uint8_t*)key);
 
@@ -147,15 +186,6 @@ for table in hlir16.tables:
         #[               hit ? "hit" : "miss",
         #[               entry == NULL ? "(no action)" : action_names[entry->action.action_id],
         #[               hit ? "" : " (default)");
-
-        #{     if (likely(hit)) {
-        for smem in table.meters + table.counters:
-            for comp in smem.components:
-                value = "pd->parsed_length" if comp['for'] == 'bytes' else "1"
-                type = comp['type']
-                name  = comp['name']
-                #[ apply_direct_smem_$type(&(entry->state.$name), $value, "${table.name}", "${smem.smem_type}", "$name");
-        #}    }
     else:
         action = table.default_action.expression.method.ref.name if hasattr(table, 'default_action') else None
 
@@ -171,6 +201,30 @@ for table in hlir16.tables:
             #[    bool hit = false;
             #[    bool is_default = false;
 
+    if hasattr(table, 'key'):
+        #{     if (likely(hit)) {
+        for smem in table.meters + table.counters:
+            for comp in smem.components:
+                value = "pd->parsed_length" if comp['for'] == 'bytes' else "1"
+                type = comp['type']
+                name  = comp['name']
+                #[ apply_direct_smem_$type(&(entry->state.$name), $value, "${table.name}", "${smem.smem_type}", "$name");
+        #}    }
+
+    #[ #ifdef T4P4S_STATS
+    if not is_fused:
+        #{     if (unlikely(is_sampled)) {
+        #[         stats->sampled_cycles += rte_rdtsc() - lookup_start_tsc;
+        #[         ++stats->sampled_lookups;
+        #}     }
+    #[     if (hit)    ++stats->hits;
+    #[     else        ++stats->misses;
+    if hasattr(table, 'key'):
+        #[     if (!hit && entry != NULL)    ++stats->default_actions;
+    else:
+        #[     // keyless tables always execute their default action
+        #[     if (entry != NULL)    ++stats->default_actions;
+    #[ #endif
 
     # ACTIONS
     #[     if (likely(entry != 0)) {
@@ -180,7 +234,9 @@ for table in hlir16.tables:
         if action_name == 'NoAction':
             continue
         #{         case action_${action_name}:
+        #[           PROFILE_BEGIN(PROFILE_table_${table.name}_action_${action_name});
         #[           action_code_${action_name}(SHORT_STDPARAMS_IN, entry->action.${action_name}_params);
+        #[           PROFILE_END(PROFILE_table_${table.name}_action_${action_name});
         #}           break;
     #[       }
     #[     } else {
@@ -188,19 +244,95 @@ for table in hlir16.tables:
     #}     }
 
     #[     struct apply_result_s apply_result = { hit, hit ? entry->action.action_id : -1 };
+    #[     PROFILE_END(PROFILE_table_${table.name});
     #[     return apply_result;
     #} }
 
+# The key is looked up once in the merged table, then the fused tables are applied in order.
+for group in hlir16.fused_table_groups:
+    table = group[0]
+    #[ void fused_apply_${table.name}(STDPARAMS)
+    #{ {
+    #[     uint8_t key[${table.key_length_bytes}];
+    #[     table_${table.name}_key(pd, key);
+
+    #[     dbg_bytes(key, table_config[TABLE_fused_${table.name}].entry.key_size,
+    #[               " " T4LIT(????,table) " Table lookup " T4LIT(fused_${table.name},table) "/" T4LIT(EXACT) "/" T4LIT(%d) ": ",
+    #[               ${table.key_length_bytes});
+
+    #[ #ifdef T4P4S_STATS
+    #[     table_stats_t* stats = &lcore_conf[rte_lcore_id()].state.table_stats[TABLE_fused_${table.name}];
+    #[     bool is_sampled = (stats->lookups++ & T4P4S_STATS_SAMPLE_MASK) == 0;
+    #[     uint64_t lookup_start_tsc = unlikely(is_sampled) ? rte_rdtsc() : 0;
+    #[ #endif
+
+    #[     table_entry_fused_${table.name}_t* fused_entry = (table_entry_fused_${table.name}_t*)exact_lookup(tables[TABLE_fused_${table.name}], key);
+
+    #[ #ifdef T4P4S_STATS
+    #{     if (unlikely(is_sampled)) {
+    #[         stats->sampled_cycles += rte_rdtsc() - lookup_start_tsc;
+    #[         ++stats->sampled_lookups;
+    #}     }
+    #[     if (fused_entry != NULL)    ++stats->hits;
+    #[     else                        ++stats->misses;
+    #[ #endif
+
+    for fused in group:
+        #[     ${fused.name}_apply_fused(STDPARAMS_IN, fused_entry);
+    #} }
+
 
 ################################################################################
 
+# The metadata fields that may be read before they are written in the pipeline.
+# A field is considered read if it appears anywhere but on the left side of an assignment;
+# the fields of the architecture's metadata are read by the backend as well.
+# Returns None if all metadata have to be reset.
+def metadata_fields_to_reset():
+    def is_arch_metadata(typename):
+        return typename == 'standard_metadata_t' or typename.startswith('psa_')
+
+    if any(not hasattr(metainst.type, 'type_ref') for metainst in hlir16.metadata_insts):
+        return None
+
+    nodes = reachable_nodes(hlir16.objects)
+
+    meta_types = {metainst.type.type_ref.name: metainst.type.type_ref for metainst in hlir16.metadata_insts}
+
+    def meta_type_name(t):
+        t = t.type_ref if t is not None and hasattr(t, 'type_ref') else t
+        return t.get_attr('name') if t is not None and t.get_attr('name') in meta_types else None
+
+    written = {id(n.left) for n in nodes if n.get_attr('node_type') == 'AssignmentStatement'}
+    members = [n for n in nodes if n.get_attr('node_type') == 'Member' and meta_type_name(n.expr.get_attr('type')) is not None]
+    member_bases = {id(n.expr) for n in members}
+
+    read_fields = {(meta_type_name(n.expr.type), n.member) for n in members if id(n) not in written}
+    for n in nodes:
+        if n.get_attr('node_type') == 'PathExpression' and id(n) not in member_bases:
+            typename = meta_type_name(n.get_attr('type'))
+            if typename is not None:
+                # the whole struct is passed on
+                read_fields |= {(typename, fld.name) for fld in meta_types[typename].fields}
+
+    return ['field_{}_{}'.format(metainst.type.type_ref.name, fld.name)
+            for metainst in hlir16.metadata_insts
+            for fld in metainst.type.type_ref.fields
+            if is_arch_metadata(metainst.type.type_ref.name) or (metainst.type.type_ref.name, fld.name) in read_fields]
+
 #{ void reset_headers(SHORT_STDPARAMS) {
-for h in hlir16.header_instances:
-    if not h.type('type_ref', lambda t: t.is_metadata):
-        #[ pd->headers[${h.id}].pointer = NULL;
+#[     memset(pd->header_valid, 0, sizeof(pd->header_valid));
+#[     set_header_valid(pd, header_instance_all_metadatas);
+#[
 
-#[     // reset metadatas
-#[     memset(pd->headers[header_instance_all_metadatas].pointer, 0, header_info(header_instance_all_metadatas).bytewidth * sizeof(uint8_t));
+meta_fields = metadata_fields_to_reset()
+if meta_fields is None:
+    #[     memset(pd->headers[header_instance_all_metadatas].pointer, 0, header_info(header_instance_all_metadatas).bytewidth * sizeof(uint8_t));
+else:
+    #[     // reset the metadata fields that may be read before they are written
+    #[     uint8_t* meta = pd->headers[header_instance_all_metadatas].pointer;
+    for fld in meta_fields:
+        #[     memset(meta + field_byte_offset_hdr[$fld], 0, (field_bit_offset[$fld] + field_bit_width[$fld] + 7) / 8);
 #} }
 
 #{ void init_headers(SHORT_STDPARAMS) {
@@ -254,6 +386,9 @@ for table in hlir16.tables:
 #[     MODIFY_INT32_INT32_BITS_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_drop, false);
 #} }
 
+# only the fields that the program accesses through pd->fields are written back
+used_preparsed_fields = preparsed_fields_in_use(hlir16)
+
 #{ void update_packet(packet_descriptor_t* pd) {
 #[     uint32_t value32, res32;
 #[     (void)value32, (void)res32;
@@ -261,10 +396,14 @@ for hdr in hlir16.header_instances:
     if not hasattr(hdr.type, 'type_ref'):
         continue
 
+    flds = [fld for fld in hdr.type.type_ref.fields if (hdr.name, fld.name) in used_preparsed_fields]
+    if flds == []:
+        continue
+
     #[ 
     #[ // updating header instance ${hdr.name}
 
-    for fld in hdr.type.type_ref.fields:
+    for fld in flds:
         if not fld.preparsed and fld.type._type_ref.size <= 32:
             #{ if(pd->fields.attr_field_instance_${hdr.name}_${fld.name} == MODIFIED) {
             #[     value32 = pd->fields.field_instance_${hdr.name}_${fld.name};
@@ -301,12 +440,12 @@ for m in hlir16.objects['Method']:
     # TODO temporary fix for l3-routing-full, this will be computed later on
     with types({
         "T": "struct uint8_buffer_s",
-        "O": "unsigned" if not m.name == "verify_checksum" else "bitfield_handle_t",
+        "O": "unsigned" if m.name not in checksum_externs else "bitfield_handle_t",
         "HashAlgorithm": "int",
     }):
         t = m.type
         ret_type = format_type(t.returnType)
-        args = ", ".join([format_expr(arg) for arg in t.parameters.parameters] + ['STDPARAMS' if not m.name == "verify_checksum" else 'SHORT_STDPARAMS'])
+        args = ", ".join([format_expr(arg) for arg in t.parameters.parameters] + ['STDPARAMS' if m.name not in checksum_externs else 'SHORT_STDPARAMS'])
 
         #[ extern ${ret_type} ${m.name}(${args});
 
@@ -326,7 +465,9 @@ for ctl in p4_ctls:
 #{ {
 it=0
 for ctl in p4_ctls:
+    #[ PROFILE_BEGIN(PROFILE_control_${ctl.name});
     #[ control_${ctl.name}(STDPARAMS_IN);
+    #[ PROFILE_END(PROFILE_control_${ctl.name});
     if hlir16.p4_model == 'V1Switch' and it==1:
         #[ transfer_to_egress(pd);
     it = it+1;
@@ -348,16 +489,21 @@ pkt_name_indent = " " * longest_hdr_name_len
 #[     uint8_t* storage = pd->header_tmp_storage;
 #[     pd->emit_headers_length = 0;
 #{     for (int i = 0; i < pd->emit_hdrinst_count; ++i) {
-#[         header_descriptor_t hdr = pd->headers[pd->header_reorder[i]];
+#[         int hdrinst = pd->header_reorder[i];
+#[         header_descriptor_t hdr = pd->headers[hdrinst];
 
 #{         #if T4P4S_EMIT != 1
-#{             if (unlikely(hdr.pointer == NULL)) {
+#{             if (unlikely(!is_header_valid(pd, hdrinst))) {
 #[                 debug("        : $$[header][%]{longest_hdr_name_len}{s}/$${}{%02d} = " T4LIT(skipping invalid header,warning) "\n", hdr.name, hdr.length);
 #[                 continue;
 #}             }
 #}         #endif
 
-#[         dbg_bytes(hdr.pointer, hdr.length, "        : $$[header][%]{longest_hdr_name_len}{s}/$${}{%02d} = %s", hdr.name, hdr.length, hdr.pointer == NULL ? T4LIT((invalid),warning) " " : "");
+#[         dbg_bytes(hdr.pointer, hdr.length, "        : $$[header][%]{longest_hdr_name_len}{s}/$${}{%02d} = %s", hdr.name, hdr.length, !is_header_valid(pd, hdrinst) ? T4LIT((invalid),warning) " " : "");
+
+#{         if (unlikely(pd->ipv4_cksum_offload_hdr != NULL && hdr.pointer == pd->ipv4_cksum_offload_hdr)) {
+#[             pd->wrapper->l2_len = pd->emit_headers_length;
+#}         }
 
 #[         memcpy(storage, hdr.pointer, hdr.length);
 #[         storage += hdr.length;
@@ -365,32 +511,134 @@ pkt_name_indent = " " * longest_hdr_name_len
 #}     }
 #} }
 
-#[ void resize_packet_on_emit(STDPARAMS)
+#[ // Returns false if the packet could not be resized; then it is dropped.
+#[ bool resize_packet_on_emit(STDPARAMS)
 #{ {
 #{     if (likely(pd->emit_headers_length == pd->parsed_length)) {
-#[         return;
+#[         return true;
 #}     }
 #[
+#[     uint32_t res32;
 #{     if (likely(pd->emit_headers_length > pd->parsed_length)) {
 #[         int len_change = pd->emit_headers_length - pd->parsed_length;
 #[         debug("   :: Adding   $${}{%02d} bytes %${longest_hdr_name_len}{s}   : (header: from $${}{%d} bytes to $${}{%d} bytes)\n", len_change, "to packet", pd->parsed_length, pd->emit_headers_length);
 #[         char* new_ptr = rte_pktmbuf_prepend(pd->wrapper, len_change);
-#[         if (unlikely(new_ptr == 0)) {
-#[             rte_exit(1, "Could not reserve necessary headroom ($${}{%d} additional bytes)", len_change);
-#[         }
+#{         if (unlikely(new_ptr == 0)) {
+#[             debug("   :: Not enough headroom for $${}{%d} additional bytes, the headers go into a new segment\n", len_change);
+#[             new_ptr = (char*)prepend_header_segment(pd, pd->parsed_length, pd->emit_headers_length);
+#{             if (unlikely(new_ptr == 0)) {
+#[                 debug("   " T4LIT(!!,error) " Could not allocate a header segment, " T4LIT(dropping,status) " packet\n");
+#[                 MODIFY_INT32_INT32_BITS_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_drop, true);
+#[                 return false;
+#}             }
+#[             pd->data = (packet_data_t*)new_ptr;
+#[             return true;
+#}         }
 #[         pd->data = (packet_data_t*)new_ptr;
 #[     } else {
 #[         int len_change = pd->parsed_length - pd->emit_headers_length;
 #[         debug("   :: Removing $${}{%02d} bytes %${longest_hdr_name_len}{s}  : (header: from $${}{%d} bytes to $${}{%d} bytes)\n", len_change, "from packet", pd->parsed_length, pd->emit_headers_length);
 #[         char* new_ptr = rte_pktmbuf_adj(pd->wrapper, len_change);
+#{         if (unlikely(new_ptr == 0)) {
+#[             // the removed headers reach beyond the first segment
+#[             debug("   " T4LIT(!!,error) " Could not remove $${}{%d} bytes from the first segment ($${}{%d} bytes), " T4LIT(dropping,status) " packet\n", len_change, rte_pktmbuf_data_len(pd->wrapper));
+#[             MODIFY_INT32_INT32_BITS_PACKET(pd, header_instance_all_metadatas, field_standard_metadata_t_drop, true);
+#[             return false;
+#}         }
 #[         pd->data = (packet_data_t*)new_ptr;
 #}     }
 #[     pd->wrapper->pkt_len = pd->emit_headers_length + pd->payload_length;
+#[     return true;
 #} }
 
 #[ void copy_emit_contents(STDPARAMS)
 #{ {
-#[     memcpy(rte_pktmbuf_mtod(pd->wrapper, uint8_t*), pd->header_tmp_storage, pd->emit_headers_length);
+#[     write_packet_bytes(pd->wrapper, 0, pd->header_tmp_storage, pd->emit_headers_length);
+#} }
+
+#[ // The emitted headers that are already in the packet stay where they are if they can;
+#[ // only the headers before the added/removed ones are moved, and the new headers are written.
+#[ // If the headers in the packet are emitted in a different order (or the packet has bounced headers),
+#[ // it returns false without changing anything, and all headers are copied through header_tmp_storage.
+#[ bool emit_headers_in_place(STDPARAMS)
+#{ {
+#[     if (unlikely(pd->bounce_length != 0))    return false;
+#[
+#[     uint8_t* old_base = (uint8_t*)pd->data;
+#[     uint8_t* old_end  = old_base + pd->parsed_length;
+#[     uint8_t* prev_end = old_base;
+#[
+#[     int emitted[HEADER_INSTANCE_COUNT+8];
+#[     int offsets[HEADER_INSTANCE_COUNT+8];
+#[     int emitted_count = 0;
+#[     int emit_length = 0;
+#{     for (int i = 0; i < pd->emit_hdrinst_count; ++i) {
+#[         int hdrinst = pd->header_reorder[i];
+#{         #if T4P4S_EMIT != 1
+#[             if (unlikely(!is_header_valid(pd, hdrinst)))    continue;
+#}         #endif
+#[         header_descriptor_t* hdr = &pd->headers[hdrinst];
+#[         uint8_t* src = hdr->pointer;
+#{         if (src >= old_base && src < old_end) {
+#[             if (unlikely(src < prev_end))    return false;
+#[             prev_end = src + hdr->length;
+#}         }
+#[
+#{         if (unlikely(pd->ipv4_cksum_offload_hdr != NULL && src == pd->ipv4_cksum_offload_hdr)) {
+#[             pd->wrapper->l2_len = emit_length;
+#}         }
+#[
+#[         emitted[emitted_count] = hdrinst;
+#[         offsets[emitted_count] = emit_length;
+#[         ++emitted_count;
+#[         emit_length += hdr->length;
+#}     }
+#[
+#[     // the headers go into a new segment if the headroom is too small, and that is done by copying them
+#[     int len_change = emit_length - pd->parsed_length;
+#[     if (unlikely(len_change > 0 && len_change > rte_pktmbuf_headroom(pd->wrapper)))    return false;
+#[
+#[     pd->emit_headers_length = emit_length;
+#[     if (unlikely(!resize_packet_on_emit(STDPARAMS_IN)))    return true;
+#[     uint8_t* new_base = (uint8_t*)pd->data;
+#[
+#[     // the headers in the packet keep their order, so the ones moving to the front are moved front to back,
+#[     // the ones moving to the back are moved back to front, and neither overwrites a header that is still to be moved
+#[     int moved_count = 0;
+#{     for (int i = 0; i < emitted_count; ++i) {
+#[         header_descriptor_t* hdr = &pd->headers[emitted[i]];
+#[         uint8_t* src = hdr->pointer;
+#[         uint8_t* dst = new_base + offsets[i];
+#{         if (src >= old_base && src < old_end && dst < src) {
+#[             memmove(dst, src, hdr->length);
+#[             hdr->pointer = dst;
+#[             ++moved_count;
+#}         }
+#}     }
+#{     for (int i = emitted_count - 1; i >= 0; --i) {
+#[         header_descriptor_t* hdr = &pd->headers[emitted[i]];
+#[         uint8_t* src = hdr->pointer;
+#[         uint8_t* dst = new_base + offsets[i];
+#{         if (src >= old_base && src < old_end && dst > src) {
+#[             memmove(dst, src, hdr->length);
+#[             hdr->pointer = dst;
+#[             ++moved_count;
+#}         }
+#}     }
+#[
+#[     // the headers that are not in the packet (e.g. the ones made valid by setValid) are written last
+#{     for (int i = 0; i < emitted_count; ++i) {
+#[         header_descriptor_t* hdr = &pd->headers[emitted[i]];
+#[         uint8_t* dst = new_base + offsets[i];
+#{         if (hdr->pointer != dst && !((uint8_t*)hdr->pointer >= old_base && (uint8_t*)hdr->pointer < old_end)) {
+#[             memcpy(dst, hdr->pointer, hdr->length);
+#[             hdr->pointer = dst;
+#[             ++moved_count;
+#}         }
+#}     }
+#[
+#[     debug("   :: Emitted $${}{%d} header instances in place, $${}{%d} of them were moved or written\n", emitted_count, moved_count);
+#[     return true;
 #} }
 
 #[ void emit_packet(STDPARAMS)
@@ -401,9 +649,14 @@ pkt_name_indent = " " * longest_hdr_name_len
 #[             return;
 #}         }
 #[         debug(" :::: Reordering emit\n");
+#[         if (likely(emit_headers_in_place(STDPARAMS_IN)))    return;
+#[
 #[         store_headers_for_emit(STDPARAMS_IN);
-#[         resize_packet_on_emit(STDPARAMS_IN);
-#[         copy_emit_contents(STDPARAMS_IN);
+#[         if (likely(resize_packet_on_emit(STDPARAMS_IN))) {
+#[             copy_emit_contents(STDPARAMS_IN);
+#[         }
+#[     } else if (unlikely(pd->bounce_length != 0)) {
+#[         write_back_bounced_headers(pd);
 #[     }
 #} }
 
@@ -412,13 +665,21 @@ pkt_name_indent = " " * longest_hdr_name_len
 #[     int value32;
 #[     int res32;
 #[
+#[     PROFILE_PACKET_START();
+#[     PROFILE_BEGIN(PROFILE_handle_packet);
+#[
 #[     reset_headers(SHORT_STDPARAMS_IN);
 #[     set_handle_packet_metadata(pd, portid);
 #[
-#[     dbg_bytes(pd->data, rte_pktmbuf_pkt_len(pd->wrapper), "Handling packet (port " T4LIT(%d,port) ", $${}{%02d} bytes)  : ", extract_ingress_port(pd), rte_pktmbuf_pkt_len(pd->wrapper));
+#[     dbg_bytes(pd->data, rte_pktmbuf_data_len(pd->wrapper), "Handling packet (port " T4LIT(%d,port) ", $${}{%02d} bytes)  : ", extract_ingress_port(pd), rte_pktmbuf_pkt_len(pd->wrapper));
 #[
 #[     pd->parsed_length = 0;
+#[     pd->parse_end = (uint8_t*)pd->data + rte_pktmbuf_data_len(pd->wrapper);
+#[     pd->bounce_length = 0;
+#[     pd->ipv4_cksum_offload_hdr = NULL;
+#[     PROFILE_BEGIN(PROFILE_parse_packet);
 #[     parse_packet(STDPARAMS_IN);
+#[     PROFILE_END(PROFILE_parse_packet);
 #[     pd->payload_length = rte_pktmbuf_pkt_len(pd->wrapper) - pd->parsed_length;
 #[
 #[     //emit_addr = pd->data;
@@ -427,5 +688,9 @@ pkt_name_indent = " " * longest_hdr_name_len
 #[
 #[     process_packet(STDPARAMS_IN);
 #[
+#[     PROFILE_BEGIN(PROFILE_emit_packet);
 #[     emit_packet(STDPARAMS_IN);
+#[     PROFILE_END(PROFILE_emit_packet);
+#[
+#[     PROFILE_END(PROFILE_handle_packet);
 #} }
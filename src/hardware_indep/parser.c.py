@@ -13,7 +13,7 @@
 # limitations under the License.
 
 from utils.misc import addError, addWarning 
-from utils.codegen import format_expr, format_statement, statement_buffer_value, format_declaration
+from utils.codegen import format_expr, format_statement, statement_buffer_value, format_declaration, preparsed_fields_in_use, fixed_field_layout
 
 
 #[ #include "dpdk_lib.h"
@@ -21,46 +21,70 @@ from utils.codegen import format_expr, format_statement, statement_buffer_value,
 
 #[ extern int get_var_width_bitwidth();
 
+# only the fields that the program accesses through pd->fields
+# and the ones whose changes are folded into a checksum are extracted there
+used_preparsed_fields = preparsed_fields_in_use(hlir16)
+
 def header_bit_width(hdrtype):
     return sum([f.size if not f.is_vw else 0 for f in hdrtype.fields])
 
-def gen_extract_header_tmp(h):
+# The headers are extracted in place if they are in the first segment of the packet,
+# otherwise they are copied into the bounce storage of the packet descriptor.
+# If the packet is too short for the headers, it is rejected.
+def gen_ensure_contiguous(s, length):
+    if length is None:
+        return
+
+    #{ if (unlikely(buf + $length > pd->parse_end)) {
+    #[     buf = parser_bounce_header(pd, $length);
+    #{     if (unlikely(buf == NULL)) {
+    #[         PROFILE_END(PROFILE_parser_state_${s.name});
+    if has_reject_state:
+        #[         goto parser_state_reject;
+    else:
+        #[         return;
+    #}     }
+    #} }
+
+def gen_extract_header_tmp(s, h, checked_length):
+    #[ ${gen_ensure_contiguous(s, checked_length)}
     #[ memcpy(pstate->${h.ref.name}, buf, ${h.type.byte_width});
     #[ buf += ${h.type.byte_width};
     #[ pd->parsed_length += ${h.type.byte_width};
 
-def gen_extract_header_tmp_2(hdrinst, hdrtype, w):
+def gen_extract_header_tmp_2(s, hdrinst, hdrtype, w):
     x = header_bit_width(hdrtype)
     w = format_expr(w)
     #[ int hdrlen = ((${w}+${x})/8);
+    #[ ${gen_ensure_contiguous(s, 'hdrlen')}
     #[ pd->parsed_length += hdrlen;
     #[ memcpy(pstate->${hdrinst.ref.name}, buf, hdrlen);
     #[ pstate->${hdrinst.ref.name}_var += ${w}+${x};
     #[ buf += hdrlen;
 
 
-def gen_extract_header(hdrinst, hdrtype):
+def gen_extract_header(s, hdrinst, hdrtype, checked_length):
     if hdrinst is None:
         addError("extracting header", "no instance found for header type " + hdrtype.name)
         return
 
-    #[ if((int)((uint8_t*)buf-(uint8_t*)(pd->data))+${hdrtype.byte_width} > pd->wrapper->pkt_len)
-    #[     ; // packet_too_short // TODO optimize this
+    #[ ${gen_ensure_contiguous(s, checked_length)}
     #[ pd->headers[${hdrinst.id}].pointer = buf;
+    #[ set_header_valid(pd, ${hdrinst.id});
     #[ pd->headers[${hdrinst.id}].length = ${hdrtype.byte_width};
     #[ pd->parsed_length += ${hdrtype.byte_width};
     #[ buf += pd->headers[${hdrinst.id}].length;
     for f in hdrtype.fields:
-        # TODO get rid of "f.get_attr('preparsed') is not None"
-        # TODO (f must always have a preparsed attribute)
-        if f.size <= 32: # that appears to be important...
+        if f.size <= 32 and (hdrinst.name, f.name) in used_preparsed_fields:
+            layout = fixed_field_layout(hdrtype, f)
+            if layout is not None:
+                #[ EXTRACT_INT32_FIXED_PACKET(pd, ${hdrinst.id}, $layout, value32)
+            else:
+                #[ EXTRACT_INT32_AUTO_PACKET(pd, ${hdrinst.id}, ${f.id}, value32)
             #[ pd->fields.attr_field_instance_${hdrinst.name}_${f.name} = 0;
-        if f.get_attr('preparsed') is not None and f.preparsed and f.size <= 32:
-            #[ EXTRACT_INT32_AUTO_PACKET(pd, ${hdrinst.id}, ${f.id}, value32)
-            #[ pd->fields.${f.id} = value32;
-            #[ pd->fields.attr_${f.id} = 0;
+            #[ pd->fields.field_instance_${hdrinst.name}_${f.name} = value32;
 
-def gen_extract_header_2(hdrinst, hdrtype, w):
+def gen_extract_header_2(s, hdrinst, hdrtype, w):
     if not hdrtype.is_vw:
         addError("generating extract header call", "fixed-width header extracted with two-param extract")
         return
@@ -69,14 +93,15 @@ def gen_extract_header_2(hdrinst, hdrtype, w):
 
     #[ uint32_t hdrlen = ((${format_expr(w)}+${x})/8);
 
-    #[ if ((int)((uint8_t*)buf-(uint8_t*)(pd->data))+hdrlen > pd->wrapper->pkt_len)
-    #[     ; // packet_too_short // TODO optimize this
+    #[ ${gen_ensure_contiguous(s, 'hdrlen')}
     #[ if (hdrlen > ${hdrtype.byte_width})
     #[     debug("    " T4LIT(!,warning) " header " T4LIT(${hdrinst.name},header) " is too long (" T4LIT(%d,warning) " bytes)\n", hdrlen);
     #[ pd->headers[${hdrinst.id}].pointer = buf;
+    #[ set_header_valid(pd, ${hdrinst.id});
     #[ pd->headers[${hdrinst.id}].length = hdrlen;
     #[ pd->parsed_length += hdrlen;
     #[ pd->headers[${hdrinst.id}].var_width_field_bitwidth = hdrlen * 8 - ${header_bit_width(hdrtype)};
+    #[ buf += hdrlen;
 
 
 ################################################################################
@@ -91,15 +116,152 @@ for l in parser.parserLocals:
         #[ ${l.type.type_ref.name}_t_init(pstate->${l.name});
 #} }
 
-for s in parser.states:
-    #[ static void parser_state_${s.name}(packet_descriptor_t* pd, uint8_t* buf, lookup_table_t** tables, parser_state_t* pstate);
+has_reject_state = any(s.name == 'reject' for s in parser.states)
+
+def get_extracted_header(c):
+    hdrtype = c.header.type_ref if hasattr(c.header, 'type_ref') else c.header
+
+    # TODO find a more universal way to get to the header instance
+    if hasattr(c.methodCall.arguments[0].expression, 'path'):
+        hdrinst_name = c.methodCall.arguments['Argument'][0].expression.path.name
+
+        dvar = parser.parserLocals.get(hdrinst_name, 'Declaration_Variable')
+        if dvar:
+            hdrinst = dvar.type.type_ref
+            hdrtype = dvar.type.type_ref
+        else:
+            hdrinst = hlir16.header_instances.get(hdrinst_name, 'Declaration_Variable', lambda hi: hi.type.type_ref.name == hdrtype.name)
+    elif hasattr(c.methodCall.method.expr, 'header_ref'):
+        hdrinst = c.methodCall.method.expr.header_ref
+    else:
+        hdrinst_name = c.methodCall.arguments[0].expression.member
+        hdrinst = hlir16.header_instances.get(hdrinst_name, 'StructField', lambda hi: hi.type.type_ref.name == hdrtype.name)
+
+    # TODO there should be no "secondary" hdrtype node
+    if not hasattr(hdrtype, 'bit_width'):
+        hdrtype = hlir16.header_types.get(hdrtype.name, 'Type_Header')
+
+    return hdrinst, hdrtype
+
+def extract_calls(s):
+    return [c for c in s.components if hasattr(c, 'call') and c.call == 'extract_header']
+
+# Consecutive fixed width extracts of a state are bounds checked together:
+# the first one checks the total length of the run, the rest are not checked.
+# The run is bounced together, too, if it does not fit into the first segment.
+def checked_lengths(s):
+    lengths = {}
+    run = []
+    for c in extract_calls(s) + [None]:
+        if c is not None and not c.is_vw:
+            run.append(c)
+            continue
+        if run != []:
+            lengths[run[0].id] = sum(get_extracted_header(rc)[1].byte_width for rc in run)
+            for rc in run[1:]:
+                lengths[rc.id] = None
+        run = []
+    return lengths
+
+
+def transitions(s):
+    if not hasattr(s, 'selectExpression'):
+        return []
+    b = s.selectExpression
+    if b.node_type == 'PathExpression':
+        return [(b.path.name, None)]
+    return [(case.state.path.name, case.keyset) for case in b.selectCases]
+
+def get_state(name):
+    return next((s for s in parser.states if s.name == name), None)
+
+# The header at the beginning of the packet, if the parser always extracts the same one there.
+def get_outermost_header():
+    s = get_state('start')
+    visited = set()
+    while s is not None and s.name not in visited:
+        visited.add(s.name)
+        calls = extract_calls(s)
+        if calls != []:
+            return None if calls[0].is_tmp or calls[0].is_vw else get_extracted_header(calls[0])
+        trans = transitions(s)
+        s = get_state(trans[0][0]) if len(trans) == 1 and trans[0][1] is None else None
+    return None
+
+outermost_header = get_outermost_header()
+
+def only_extracted_header(s):
+    calls = extract_calls(s)
+    if len(calls) != 1 or calls[0].is_tmp or calls[0].is_vw:
+        return None
+    return get_extracted_header(calls[0])[0]
+
+# Selects that the packet type classification of the NIC can decide (option `ptype`):
+# on the EtherType of the outermost Ethernet header,
+# and on the protocol of the IPv4/IPv6 header that directly follows it.
+def ptype_select(s):
+    b = s.get_attr('selectExpression')
+    if b is None or b.node_type != 'SelectExpression' or len(b.select.components) != 1:
+        return None
+    k = b.select.components[0]
+    if not hasattr(k, 'field_ref') or not hasattr(k.expr, 'header_ref') or not hasattr(k.field_ref, 'offset'):
+        return None
+
+    hdrinst = only_extracted_header(s)
+    if hdrinst is None or hdrinst.name != k.expr.header_ref.name:
+        return None
+
+    field_pos = (k.field_ref.offset, k.field_ref.size)
+    if outermost_header is not None and hdrinst.name == outermost_header[0].name:
+        is_ethernet = outermost_header[1].byte_width == 14 and field_pos == (96, 16)
+        return 'ptype_ether_type' if is_ethernet else None
+
+    ether_types = {(72, 8): 0x0800, (48, 8): 0x86dd}
+    if field_pos not in ether_types:
+        return None
+    preds = [(pred, keyset) for pred in parser.states for target, keyset in transitions(pred) if target == s.name]
+    if len(preds) != 1:
+        return None
+    pred, keyset = preds[0]
+    if ptype_select(pred) != 'ptype_ether_type' or keyset is None or keyset.node_type != 'Constant' or keyset.value != ether_types[field_pos]:
+        return None
+    return 'ptype_ip_proto'
+
+# The targets of the constant cases that precede all other cases.
+def ptype_cases(s):
+    cases = []
+    for value, target in ((case.keyset.get_attr('value'), case.state.path.name) for case in s.selectExpression.selectCases):
+        if value is None:
+            break
+        if value not in [v for v, t in cases]:
+            cases.append((value, target))
+    return cases
+
+def gen_ptype_select(s, ptype_fun):
+    #[ #ifdef T4P4S_PTYPE
+    #{ switch (${ptype_fun}(pd)) {
+    for value, target in ptype_cases(s):
+        hex_value = '0x%x' % value
+        #[     case $hex_value: goto parser_state_${target};
+    #} }
+    #[ #endif
+
+
+# The states are the labels of one function, the transitions jump between them.
+#{ void parse_packet(STDPARAMS) {
+#[     uint8_t* buf = (uint8_t*)pd->data;
+#[     uint32_t value32; (void)value32;
+#[     uint32_t res32; (void)res32;
+#[     parser_state_t* local_vars = pstate;
+#[     goto parser_state_start;
 
 for s in parser.states:
-    #[ static void parser_state_${s.name}(packet_descriptor_t* pd, uint8_t* buf, lookup_table_t** tables, parser_state_t* pstate) {
-    #[     uint32_t value32; (void)value32;
-    #[     uint32_t res32; (void)res32;
-    #[     parser_state_t* local_vars = pstate;
+    lengths = checked_lengths(s)
+
+    #[ parser_state_${s.name}:
+    #{ {
     #[     debug(" :::: Parser state $$[parserstate]{s.name}\n");
+    #[     PROFILE_BEGIN(PROFILE_parser_state_${s.name});
 
     for c in s.components:
         if not hasattr(c, 'call'):
@@ -111,51 +273,33 @@ for s in parser.states:
 
         #[ // CALL ${c} ${s}
 
-        hdrtype = c.header.type_ref if hasattr(c.header, 'type_ref') else c.header
-
-        # TODO find a more universal way to get to the header instance
-        if hasattr(c.methodCall.arguments[0].expression, 'path'):
-            hdrinst_name = c.methodCall.arguments['Argument'][0].expression.path.name
+        hdrinst, hdrtype = get_extracted_header(c)
 
-            dvar = parser.parserLocals.get(hdrinst_name, 'Declaration_Variable')
-            if dvar:
-                hdrinst = dvar.type.type_ref
-                hdrtype = dvar.type.type_ref
-            else:
-                hdrinst = hlir16.header_instances.get(hdrinst_name, 'Declaration_Variable', lambda hi: hi.type.type_ref.name == hdrtype.name)
-        elif hasattr(c.methodCall.method.expr, 'header_ref'):
-            hdrinst = c.methodCall.method.expr.header_ref
-        else:
-            hdrinst_name = c.methodCall.arguments[0].expression.member
-            hdrinst = hlir16.header_instances.get(hdrinst_name, 'StructField', lambda hi: hi.type.type_ref.name == hdrtype.name)
-
-        # TODO there should be no "secondary" hdrtype node
-        if not hasattr(hdrtype, 'bit_width'):
-            hdrtype = hlir16.header_types.get(hdrtype.name, 'Type_Header')
-            
         bitwidth = hdrtype.bit_width if not c.is_vw else header_bit_width(hdrtype)
 
         if not c.is_tmp:
             if not c.is_vw:
-                #[ ${gen_extract_header(hdrinst, hdrtype)}
+                #[ ${gen_extract_header(s, hdrinst, hdrtype, lengths[c.id])}
             else:
-                #[ ${gen_extract_header_2(hdrinst, hdrtype, c.width)}
+                #[ ${gen_extract_header_2(s, hdrinst, hdrtype, c.width)}
             #[ dbg_bytes(pd->headers[${hdrinst.id}].pointer, pd->headers[${hdrinst.id}].length,
             #[           "   :: Extracted header $$[header]{hdrinst.name} ($${(bitwidth+7)/8}{ bytes}): ");
         else:
             if not c.is_vw:
-                #[ ${gen_extract_header_tmp(hdrinst)}
+                #[ ${gen_extract_header_tmp(s, hdrinst, lengths[c.id])}
                 #[ dbg_bytes(pstate->${hdrinst.ref.name}, ${hdrtype.byte_width},
                 #[           "   :: Extracted header $$[header]{hdrinst.path.name} of type $${hdrinst.type.name} ($${bitwidth} bits, $${hdrtype.byte_width} bytes): ");
 
             else:
-                #[ ${gen_extract_header_tmp_2(hdrinst, hdrtype, c.width)}
+                #[ ${gen_extract_header_tmp_2(s, hdrinst, hdrtype, c.width)}
                 hdr_width = header_bit_width(hdrtype)
                 var_width = format_expr(c.width)
                 #[ dbg_bytes(pstate->${hdrinst.ref.name}, (($hdr_width + $var_width)+7)/8,
                 #[           "   :: Extracted header $$[header]{hdrinst.path.name} of type $${hdrtype.name}: ($${hdr_width}+$${}{%d} bits, $${}{%d} bytes): ",
                 #[           $var_width, (($hdr_width + $var_width)+7)/8);
 
+    #[     PROFILE_END(PROFILE_parser_state_${s.name});
+
     if not hasattr(s, 'selectExpression'):
         if s.name == 'accept':
             #[ debug("   :: Packet is $$[success]{}{accepted}\n");
@@ -167,17 +311,19 @@ for s in parser.states:
         bexpr = format_expr(b)
         prebuf, postbuf = statement_buffer_value()
 
+        ptype_fun = ptype_select(s)
+        if ptype_fun is not None:
+            #[ ${gen_ptype_select(s, ptype_fun)}
+
         #[ $prebuf
         if b.node_type == 'PathExpression':
-            #[ parser_state_$bexpr(pd, buf, tables, pstate);
+            #[ goto parser_state_$bexpr;
         elif b.node_type == 'SelectExpression':
             #= bexpr
         #[ $postbuf
-    #[ }
-
-#[ void parse_packet(packet_descriptor_t* pd, lookup_table_t** tables, parser_state_t* pstate) {
-#[     parser_state_start(pd, pd->data, tables, pstate);
-#[ }
+    #[     return;
+    #} }
+#} }
 
 
 #{ const char* header_instance_names[HEADER_INSTANCE_COUNT] = {
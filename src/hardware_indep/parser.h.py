@@ -7,6 +7,7 @@
 # OF ANY KIND, either express or implied. See the License for the specific
 # language governing permissions and limitations under the License.
 from hlir16.utils_hlir16 import *
+from utils.codegen import preparsed_fields_in_use
 
 
 #[ #ifndef __HEADER_INFO_H__
@@ -22,6 +23,10 @@ from hlir16.utils_hlir16 import *
 #[ typedef struct {} InternetChecksum_t;
 
 
+# only the fields that the program accesses through pd->fields
+# and the ones whose changes are folded into a checksum are stored there
+used_preparsed_fields = preparsed_fields_in_use(hlir16)
+
 #{ typedef struct parsed_fields_s {
 
 for hdr in hlir16.header_instances_with_refs:
@@ -31,8 +36,7 @@ for hdr in hlir16.header_instances_with_refs:
     for fld in hdr.type.type_ref.fields:
         fld = fld._expression
 
-        # if fld('preparsed', False) and fld.type.size <= 32:
-        if fld.type._type_ref.size <= 32:
+        if fld.type._type_ref.size <= 32 and (hdr.name, fld.name) in used_preparsed_fields:
             #[ uint32_t field_instance_${hdr.name}_${fld.name};
             #[ uint8_t attr_field_instance_${hdr.name}_${fld.name};
 #} } parsed_fields_t;
@@ -0,0 +1,58 @@
+# Copyright 2018 Eotvos Lorand University, Budapest, Hungary
+# 
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+# 
+#     http://www.apache.org/licenses/LICENSE-2.0
+# 
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+#[ #ifndef __PROFILE_H__
+#[ #define __PROFILE_H__
+
+# The profiling points of the generated code (used with the `profile` option).
+# Each point has a folded stack path that reflects how the generated functions nest,
+# see dpdk_profile.h.
+
+parser = hlir16.objects['P4Parser'][0]
+table_controls = {t.name: ctl for ctl in hlir16.objects['P4Control'] for t in ctl.controlLocals['P4Table']}
+
+points = []
+points.append(('handle_packet', 'handle_packet'))
+points.append(('parse_packet', 'handle_packet;parse_packet'))
+for s in parser.states:
+    points.append(('parser_state_{}'.format(s.name), 'handle_packet;parse_packet;parser_state_{}'.format(s.name)))
+
+for ctl in hlir16.objects['P4Control']:
+    points.append(('control_{}'.format(ctl.name), 'handle_packet;process_packet;control_{}'.format(ctl.name)))
+
+for table in hlir16.tables:
+    ctl = table_controls.get(table.name)
+    ctl_path = 'handle_packet;process_packet;control_{}'.format(ctl.name) if ctl is not None else 'handle_packet;process_packet'
+    table_path = '{};table_{}'.format(ctl_path, table.name)
+    points.append(('table_{}'.format(table.name), table_path))
+    for action in table.actions:
+        action_name = action.action_object.name
+        points.append(('table_{}_action_{}'.format(table.name, action_name), '{};action_{}'.format(table_path, action_name)))
+
+points.append(('emit_packet', 'handle_packet;emit_packet'))
+
+
+#[ #define NB_PROFILE_POINTS ${len(points)}
+
+#{ enum profile_point_e {
+for name, path in points:
+    #[ PROFILE_$name,
+#} };
+
+#{ static const char* const profile_point_paths[NB_PROFILE_POINTS] = {
+for name, path in points:
+    #[ "$path", // PROFILE_$name
+#} };
+
+#[ #endif
@@ -39,6 +39,28 @@ for table in hlir16.tables:
     #[      .validity_size = sizeof(entry_validity_t),
     #[  },
 
+    #[  .min_size = 0,
+    #[  .max_size = 250000,
+    #[ },
+
+for group in hlir16.fused_table_groups:
+    name = "fused_{}".format(group[0].name)
+    #[ {
+    #[  .name= "$name",
+    #[  .id = TABLE_$name,
+    #[  .type = LOOKUP_EXACT,
+
+    #[  .entry = {
+    #[      .entry_count = 0,
+
+    #[      .key_size = ${group[0].key_length_bytes},
+
+    #[      .entry_size = sizeof(struct ${name}_action) + sizeof(entry_validity_t),
+    #[      .action_size   = sizeof(struct ${name}_action),
+    #[      .state_size    = 0,
+    #[      .validity_size = sizeof(entry_validity_t),
+    #[  },
+
     #[  .min_size = 0,
     #[  .max_size = 250000,
     #[ },
@@ -27,12 +27,26 @@ for t in hlir16.tables:
     #[     entry_validity_t         is_entry_valid;
     #} } table_entry_${t.name}_t;
 
+# the entries of a merged table hold the entries of the fused tables
+for group in hlir16.fused_table_groups:
+    #{ struct fused_${group[0].name}_action {
+    for t in group:
+        #[     table_entry_${t.name}_t  ${t.name};
+    #} };
+
+    #{ typedef struct table_entry_fused_${group[0].name}_s {
+    #[     struct fused_${group[0].name}_action  action;
+    #[     entry_validity_t         is_entry_valid;
+    #} } table_entry_fused_${group[0].name}_t;
+
 
-#[ #define NB_TABLES ${len(hlir16.tables)}
+#[ #define NB_TABLES ${len(hlir16.tables) + len(hlir16.fused_table_groups)}
 
 #{ enum table_names {
 for table in hlir16.tables:
     #[ TABLE_${table.name},
+for group in hlir16.fused_table_groups:
+    #[ TABLE_fused_${group[0].name},
 #[ TABLE_,
 #} };
 
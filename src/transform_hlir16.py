@@ -60,6 +60,344 @@ def search_for_annotations(stmt):
     return stmt
 
 
+################################################################################
+# Optimisation: constant folding, dead code and unused table/action/control elimination
+
+unsigned_ops = {
+    'Add':    lambda a, b, w: a + b,
+    'Sub':    lambda a, b, w: a - b,
+    'Mul':    lambda a, b, w: a * b,
+    'Div':    lambda a, b, w: a // b if b != 0 else None,
+    'Mod':    lambda a, b, w: a % b if b != 0 else None,
+    'Shl':    lambda a, b, w: a << b if b < 4096 else None,
+    'Shr':    lambda a, b, w: a >> b,
+    'BAnd':   lambda a, b, w: a & b,
+    'BOr':    lambda a, b, w: a | b,
+    'BXor':   lambda a, b, w: a ^ b,
+    'AddSat': lambda a, b, w: min(a + b, 2**w - 1) if w is not None else None,
+    'SubSat': lambda a, b, w: max(a - b, 0),
+}
+
+comparison_ops = {
+    'Equ': lambda a, b: a == b,
+    'Neq': lambda a, b: a != b,
+    'Lss': lambda a, b: a < b,
+    'Leq': lambda a, b: a <= b,
+    'Grt': lambda a, b: a > b,
+    'Geq': lambda a, b: a >= b,
+}
+
+def is_unsigned_constant(e):
+    if e.get_attr('node_type') != 'Constant':
+        return False
+    t = e.type
+    return t.node_type == 'Type_InfInt' or (t.node_type == 'Type_Bits' and not t.isSigned)
+
+def is_bool_literal(e):
+    return e.get_attr('node_type') == 'BoolLiteral'
+
+def make_constant(e, value, base):
+    t = e.type
+    if t.node_type == 'Type_Bits':
+        if t.isSigned:
+            return None
+        value %= 2**t.size
+    elif t.node_type != 'Type_InfInt':
+        return None
+
+    node = P4Node()
+    node.node_type = 'Constant'
+    node.type      = t
+    node.value     = value
+    node.base      = base
+    node.id        = get_fresh_node_id()
+    return node
+
+def make_bool_literal(e, value):
+    node = P4Node()
+    node.node_type = 'BoolLiteral'
+    node.type      = e.type
+    node.value     = value
+    node.id        = get_fresh_node_id()
+    return node
+
+# Returns the value of the expression if it can be computed at compile time, otherwise None.
+def folded_expr(e):
+    node_type = e.get_attr('node_type')
+
+    if node_type in unsigned_ops and is_unsigned_constant(e.left) and is_unsigned_constant(e.right):
+        width = e.type.size if e.type.node_type == 'Type_Bits' else None
+        value = unsigned_ops[node_type](e.left.value, e.right.value, width)
+        return make_constant(e, value, e.left.get_attr('base') or 10) if value is not None else None
+    if node_type in comparison_ops and is_unsigned_constant(e.left) and is_unsigned_constant(e.right):
+        return make_bool_literal(e, comparison_ops[node_type](e.left.value, e.right.value))
+    if node_type in ('Cmpl', 'Neg') and is_unsigned_constant(e.expr) and e.type.node_type == 'Type_Bits':
+        value = ~e.expr.value if node_type == 'Cmpl' else -e.expr.value
+        return make_constant(e, value, e.expr.get_attr('base') or 10)
+    if node_type == 'Cast' and is_unsigned_constant(e.expr) and e.type.node_type == 'Type_Bits':
+        return make_constant(e, e.expr.value, e.expr.get_attr('base') or 10)
+
+    if node_type == 'LNot' and is_bool_literal(e.expr):
+        return make_bool_literal(e, not e.expr.value)
+    if node_type in ('LAnd', 'LOr') and is_bool_literal(e.left) and is_bool_literal(e.right):
+        value = e.left.value and e.right.value if node_type == 'LAnd' else e.left.value or e.right.value
+        return make_bool_literal(e, value)
+    if node_type == 'Mux' and is_bool_literal(e.e0):
+        return e.e1 if e.e0.value else e.e2
+
+    return None
+
+# The references point to declarations, which are folded where they are declared.
+def is_reference_attr(attr):
+    return attr == 'ref' or attr.endswith('_ref') or attr == 'action_object'
+
+def fold_constants(node, seen):
+    if id(node) in seen:
+        return
+    seen.add(id(node))
+
+    def fold(value):
+        fold_constants(value, seen)
+        folded = folded_expr(value)
+        return folded if folded is not None else value
+
+    for attr, value in vars(node).items():
+        if is_reference_attr(attr):
+            continue
+        if isinstance(value, P4Node):
+            setattr(node, attr, fold(value))
+        elif type(value) is list:
+            value[:] = [fold(v) if isinstance(v, P4Node) else v for v in value]
+
+    # the branch that is never taken is dropped
+    if node.get_attr('node_type') == 'IfStatement' and is_bool_literal(node.condition):
+        dead_branch = 'ifFalse' if node.condition.value else 'ifTrue'
+        if hasattr(node, dead_branch):
+            delattr(node, dead_branch)
+
+# The nodes that can be reached from the root (or the list of roots), following references as well.
+# The code generators use it, too.
+def reachable_nodes(root):
+    nodes, todo, seen = [], list(root) if type(root) is list else [root], set()
+    while todo != []:
+        node = todo.pop()
+        if id(node) in seen:
+            continue
+        seen.add(id(node))
+        nodes.append(node)
+        for value in vars(node).values():
+            todo += [v for v in (value if type(value) is list else [value]) if isinstance(v, P4Node)]
+    return nodes
+
+def remove_nodes(container, is_removed):
+    items = container.vec if hasattr(container, 'vec') else container
+    removed = [item for item in items if is_removed(item)]
+    items[:] = [item for item in items if not is_removed(item)]
+    return removed
+
+# Controls that are neither in the pipeline nor instantiated by a control in the pipeline,
+# tables that are never applied and actions that no table and no control refers to are removed.
+def remove_unused_objects(hlir16):
+    pipeline_controls = [hlir16.objects.get(pe.expression.type.name, 'P4Control') for pe in hlir16.p4_main.arguments]
+    pipeline_controls = [ctl for ctl in pipeline_controls if ctl is not None]
+    if pipeline_controls == []:
+        return
+
+    reached = reachable_nodes(pipeline_controls)
+    used_controls = set(n.name for n in reached if n.get_attr('node_type') == 'P4Control')
+
+    used_bodies = [ctl.body for ctl in hlir16.controls if ctl.name in used_controls]
+    paths = [n for n in reachable_nodes(used_bodies) if n.get_attr('node_type') == 'PathExpression']
+    # if a reference is not resolved, its name is used
+    referred_names = set(n.ref.name if n.get_attr('ref') is not None else n.path.name for n in paths)
+    applied_tables = set(t.name for t in hlir16.tables if t.name in referred_names)
+
+    def is_unused_control(ctl):
+        return ctl.get_attr('node_type') == 'P4Control' and ctl.name not in used_controls
+    def is_unused_table(t):
+        return t.get_attr('node_type') == 'P4Table' and t.name not in applied_tables
+
+    remove_nodes(hlir16.controls, is_unused_control)
+    remove_nodes(hlir16.objects, is_unused_control)
+    remove_nodes(hlir16.tables, is_unused_table)
+    for ctl in hlir16.controls:
+        remove_nodes(ctl.controlLocals, is_unused_table)
+
+    used_actions = set(a.action_object.name for t in hlir16.tables for a in t.actions)
+    used_actions |= referred_names
+
+    def is_unused_action(act):
+        return act.get_attr('node_type') == 'P4Action' and act.name not in used_actions
+    for ctl in hlir16.controls:
+        remove_nodes(ctl.actions, is_unused_action)
+        remove_nodes(ctl.controlLocals, is_unused_action)
+
+def applied_table(hlir16, stmt):
+    if stmt.get_attr('node_type') != 'MethodCallStatement':
+        return None
+    m = stmt.methodCall.method
+    if m.get_attr('member') != 'apply' or m.expr.get_attr('node_type') != 'PathExpression':
+        return None
+    ref = m.expr.get_attr('ref')
+    if ref is None or ref.get_attr('node_type') != 'P4Table':
+        return None
+    return next((t for t in hlir16.tables if t.name == ref.name), None)
+
+def table_key_fields(table):
+    return [(k.header_name, k.field_name, k.get_attr('width')) for k in table.key.keyElements]
+
+# The name of the field or header that is written through the expression.
+def written_name(e):
+    while e.get_attr('node_type') in ['Slice', 'ArrayIndex']:
+        e = e.e0 if e.node_type == 'Slice' else e.left
+    if e.get_attr('node_type') == 'Member':
+        return e.member
+    if e.get_attr('node_type') == 'PathExpression':
+        return e.path.name
+    return None
+
+# Fields are compared by their names only, which errs on the side of not fusing.
+def may_change_key(table, key_fields):
+    key_names = {name for hdr, fld, width in key_fields for name in [hdr, fld]}
+    for action in table.actions:
+        for n in reachable_nodes(action.action_object.body):
+            if n.get_attr('node_type') in ['ExitStatement', 'ReturnStatement']:
+                return True
+            if n.get_attr('node_type') == 'AssignmentStatement' and written_name(n.left) in key_names:
+                return True
+            if n.get_attr('node_type') == 'MethodCallExpression':
+                # the methods of headers (e.g. setValid) and the arguments of externs
+                targets = [n.method.expr] if n.method.get_attr('node_type') == 'Member' else []
+                targets += [a.expression if a.get_attr('expression') is not None else a for a in n.arguments]
+                if any(written_name(e) in key_names for e in targets):
+                    return True
+    return False
+
+def fusion_groups(hlir16):
+    bodies = [ctl.body for ctl in hlir16.controls]
+    refs = [n.ref for n in reachable_nodes(bodies) if n.get_attr('node_type') == 'PathExpression' and n.get_attr('ref') is not None]
+    apply_counts = {t.name: len([ref for ref in refs if ref.get_attr('node_type') == 'P4Table' and ref.name == t.name]) for t in hlir16.tables}
+
+    # a table that is applied elsewhere as well is not fused
+    def is_fusable(table):
+        return table is not None and hasattr(table, 'key') and table.match_type == 'EXACT' and table.key_length_bytes > 0 and apply_counts[table.name] == 1
+
+    def can_follow(group, table):
+        key_fields = table_key_fields(group[0][1])
+        return is_fusable(table) and table_key_fields(table) == key_fields and not may_change_key(group[-1][1], key_fields)
+
+    groups = []
+    blocks = [n for n in reachable_nodes(bodies) if n.get_attr('node_type') == 'BlockStatement']
+    for block in blocks:
+        group = []
+        for stmt in block.components:
+            table = applied_table(hlir16, stmt)
+            if group != [] and can_follow(group, table):
+                group.append((stmt, table))
+                continue
+            groups.append(group)
+            group = [(stmt, table)] if is_fusable(table) else []
+        groups.append(group)
+    return [group for group in groups if len(group) > 1]
+
+# The exact tables that are applied one after the other with the same key
+# are merged into a table named fused_<first table>,
+# whose entries hold the entries of all of them.
+# The first apply statement is marked with the fused tables, the others with the first table.
+def fuse_tables(hlir16):
+    hlir16.fused_table_groups = []
+    for group in fusion_groups(hlir16):
+        first_stmt, first_table = group[0]
+        first_stmt.fused_tables = [table for stmt, table in group]
+        for stmt, table in group:
+            stmt.fused_into = first_table.name
+            table.fused_into = first_table.name
+        hlir16.fused_table_groups.append(first_stmt.fused_tables)
+
+# The v1model externs that calculate the checksum of the listed data;
+# they get a handle to the checksum field, see dpdk_model_v1model.h.
+checksum_externs = ["verify_checksum", "update_checksum", "verify_checksum_with_payload", "update_checksum_with_payload"]
+
+def checksum_extern_name(call):
+    m = call.method
+    return m.path.name if m.get_attr('node_type') == 'PathExpression' and m.path.name in checksum_externs else None
+
+def is_header_expr(e):
+    t = e.get_attr('type')
+    t = (t.get_attr('type_ref') or t) if t is not None else None
+    return t is not None and t.get_attr('node_type') in ['Type_Header', 'Type_HeaderUnion', 'Type_Stack']
+
+# The header fields (as header instance and field names) that the program may write in the packet,
+# and the header instances that it may write as a whole.
+# A header whose field is written through pd->fields counts as written as a whole,
+# as the value parsed into pd->fields is overwritten then.
+# Returns None if the written headers cannot be told (e.g. for header stacks).
+def written_header_fields(hlir16):
+    fields, headers, unknown = set(), set(), []
+
+    def add_written(e):
+        if e.get_attr('node_type') == 'Slice':
+            return add_written(e.e0)
+        if e.get_attr('node_type') == 'ArrayIndex':
+            unknown.append(e)
+        elif e.get_attr('node_type') != 'Member':
+            return
+        elif e.get_attr('field_ref') is not None and e.expr.get_attr('header_ref') is not None:
+            fields.add((e.expr.header_ref.name, e.member))
+        elif is_header_expr(e):
+            headers.add(e.member)
+        elif e('expr.node_type') == 'Member':
+            headers.add(e.expr.member)
+
+    for n in reachable_nodes(list(hlir16.controls) + list(hlir16.objects['P4Parser'])):
+        if n.get_attr('node_type') == 'AssignmentStatement':
+            add_written(n.left)
+        if n.get_attr('node_type') != 'MethodCallExpression':
+            continue
+
+        m = n.method
+        if m.get_attr('node_type') == 'Member' and m.member in ['push_front', 'pop_front']:
+            unknown.append(n)
+        if m.get_attr('node_type') == 'Member' and m.member == 'setValid':
+            add_written(m.expr)
+
+        # the extracted headers hold the parsed values; the checksum field is written by its extern
+        if m.get_attr('member') in ['extract', 'lookahead', 'advance']:
+            continue
+        args = [a.expression if a.get_attr('expression') is not None else a for a in n.arguments]
+        params = m.get_attr('type')
+        params = params('parameters.parameters') if params is not None else None
+        directions = [par.get_attr('direction') for par in params] if params is not None else ['inout' for arg in args]
+        for idx, (arg, direction) in enumerate(zip(args, directions)):
+            if direction in ['out', 'inout'] and not (idx == 2 and checksum_extern_name(n) is not None):
+                add_written(arg)
+
+    if unknown != []:
+        return None
+    return (fields, headers)
+
+# The calls of the checksum update externs are marked with the fields that are written in the packet
+# (including the checksum fields of the other calls) and the headers that are written as a whole,
+# so that the changed fields can be folded into the current checksum, see checksum_plan in codegen.sugar.py.
+def mark_checksum_updates(hlir16):
+    written = written_header_fields(hlir16)
+    updates = [n for n in reachable_nodes(list(hlir16.controls)) if n.get_attr('node_type') == 'MethodCallExpression' and (checksum_extern_name(n) or '').startswith('update')]
+    cksum_fields = {id(c): (c.arguments[2].expression.expr.header_ref.name, c.arguments[2].expression.member) for c in updates if c.arguments[2].expression.get_attr('field_ref') is not None}
+
+    if written is None:
+        return
+    fields, headers = written
+    for call in updates:
+        call.written_fields = sorted(fields | set(fld for cid, fld in cksum_fields.items() if cid != id(call)))
+        call.written_headers = sorted(headers)
+
+def optimize_hlir16(hlir16):
+    fold_constants(hlir16.objects, set())
+    remove_unused_objects(hlir16)
+    fuse_tables(hlir16)
+    mark_checksum_updates(hlir16)
+
+
 def transform_hlir16(hlir16):
     pipeline_elements = hlir16.p4_main.arguments
 
@@ -68,4 +406,6 @@ def transform_hlir16(hlir16):
         if ctl is not None:
             ctl.body.components = map(search_for_annotations, ctl.body.components)
 
+    optimize_hlir16(hlir16)
+
     return hlir16
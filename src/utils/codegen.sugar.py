@@ -13,6 +13,7 @@
 # limitations under the License.
 
 from utils.misc import addWarning, addError
+from transform_hlir16 import reachable_nodes, checksum_externs
 
 ################################################################################
 
@@ -266,7 +267,53 @@ def gen_extern_format_parameter(expr, par):
 def member_to_field_id(member):
     return 'field_{}_{}'.format(member.expr.type.name, member.member)
 
+def bswap32(value):
+    return sum(((value >> (8*i)) & 0xff) << (8*(3-i)) for i in range(4))
+
+def is_fixed_field(hdrtype, fld):
+    if hdrtype is None or fld is None or hdrtype.get_attr('is_metadata') or hdrtype.get_attr('is_vw'):
+        return False
+    return not fld.get_attr('is_vw') and fld.get_attr('offset') is not None
+
+# The layout of a fixed width field at a fixed position in a packet header
+# as the constant arguments of the *_FIXED_PACKET macros,
+# or None if the field has to be accessed through the field tables.
+def fixed_field_layout(hdrtype, fld):
+    if not is_fixed_field(hdrtype, fld):
+        return None
+
+    bitoffset = fld.offset % 8
+    if fld.size + bitoffset > 32:
+        return None
+
+    mask = ((0xffffffff << (32 - fld.size)) & 0xffffffff) >> bitoffset
+    return '{}, {}, {}, 0x{:08x}'.format(fld.offset / 8, bitoffset, fld.size, bswap32(mask))
+
+# The same for the INT64 macros, for fields of 33 to 64 bits that fit into 8 bytes.
+def fixed_field_layout64(hdrtype, fld):
+    if not is_fixed_field(hdrtype, fld):
+        return None
+
+    bitoffset = fld.offset % 8
+    if fld.size <= 32 or fld.size + bitoffset > 64:
+        return None
+
+    return '{}, {}, {}'.format(fld.offset / 8, bitoffset, fld.size)
+
+def member_header_type(e):
+    hdr = e.expr.get_attr('header_ref')
+    if hdr is None:
+        return None
+    return hdr.type.type_ref if hasattr(hdr, 'type') else hdr.get_attr('type_ref')
+
 def gen_format_statement_fieldref_wide(dst, src, dst_width, dst_is_vw, dst_bytewidth, dst_name, dst_header_id, dst_field_id):
+    layout = fixed_field_layout64(member_header_type(dst), dst.field_ref) if not dst_is_vw else None
+    src_value = format_expr_uint64(src) if layout is not None else None
+    if src_value is not None:
+        #[ MODIFY_INT64_FIXED_PACKET(pd, $dst_header_id, $layout, $src_value)
+        #[ debug("    " T4LIT(=,field) " Modifying field " T4LIT(${dst_name},header) "." T4LIT(${dst.member},field) "/" T4LIT(${dst_width}) "b = " T4LIT(0x%llx,bytes) "\n", (unsigned long long)GET_INT64_FIXED_PACKET(pd, $dst_header_id, $layout));
+        return
+
     if src.node_type == 'Member':
         src_pointer = 'value_{}'.format(src.id)
         #[ uint8_t $src_pointer[$dst_bytewidth];
@@ -321,6 +368,12 @@ def gen_format_statement_fieldref_short(dst, src, dst_width, dst_is_vw, dst_byte
         #[ $src_buffer = ${format_expr(src)};
 
 
+    layout = fixed_field_layout(member_header_type(dst), dst.field_ref) if not dst_is_vw else None
+    if layout is not None:
+        #[ MODIFY_INT32_INT32_FIXED_PACKET(pd, $dst_header_id, $layout, $src_buffer)
+        #[ debug("    " T4LIT(=,field) " Modifying field " T4LIT(${dst_name},header) "." T4LIT(${dst.member},field) "/" T4LIT(${dst_width}) "b = " T4LIT(%d) " (0x" T4LIT(%x) ")\n", $src_buffer, $src_buffer);
+        return
+
     #[ // MODIFY_INT32_INT32_AUTO_PACKET(pd, $dst_header_id, $dst_field_id, $src_buffer)
     #[ set_field((fldT[]){{pd, $dst_header_id, $dst_field_id}}, 0, $src_buffer, $dst_width);
 
@@ -488,22 +541,29 @@ def gen_format_expr_methodcall(stmt, m):
         #[ pd->header_reorder[pd->emit_hdrinst_count] = header_instance_$hdr;
         #[ ++pd->emit_hdrinst_count;
     elif (m.expr.node_type, m.expr('ref').node_type, m.member) == ('PathExpression', 'P4Table', 'apply'):
-        #[ ${gen_method_apply(stmt.methodCall)};
+        # see table fusion in transform_hlir16.py
+        if stmt.get_attr('fused_tables') is not None:
+            #[ fused_apply_${m.expr.path.name}(STDPARAMS_IN);
+        elif stmt.get_attr('fused_into') is not None:
+            #[ // ${m.expr.path.name} is applied by fused_apply_${stmt.fused_into}
+        else:
+            #[ ${gen_method_apply(stmt.methodCall)};
     elif m.expr.get_attr('member') is None:
         return gen_format_expr_methodcall_extern(stmt, m)
     else:
         hdr_name = m.expr.member
 
         if m.member == 'isValid':
-            #[ controlLocal_tmp_0 = (pd->headers[header_instance_$hdr_name].pointer != NULL);
+            #[ controlLocal_tmp_0 = is_header_valid(pd, header_instance_$hdr_name);
         elif m.member == 'setValid':
             #[ debug("   :: Setting header instance $$[header]{hdr_name} as $$[success]{}{valid}\n");
             #[ pd->headers[header_instance_$hdr_name].pointer = (pd->header_tmp_storage + header_instance_byte_width_summed[header_instance_$hdr_name]);
+            #[ set_header_valid(pd, header_instance_$hdr_name);
             #[ // TODO initialise header instance contents on setValid?
             #[
         elif m.member == 'setInvalid':
             #[ debug("    : Setting header instance $$[header]{hdr_name} as $$[success]{}{invalid}\n");
-            #[ pd->headers[header_instance_$hdr_name].pointer = NULL;
+            #[ set_header_invalid(pd, header_instance_$hdr_name);
         else:
             #= gen_methodcall(stmt)
 
@@ -698,25 +758,126 @@ def listexpression_to_buf(expr):
     # TODO add support for component.node_type == 'Constant'
     components = [('tuple', c[0], c[1]) if type(c) == tuple else convert_component(c) for c in map(resolve_reference, expr.components)]
     components = [(c[1], c[2]) for c in components if c is not None if c[0] != 'Constant']
-    for h, fs in group_references(components):
+    groups = list(group_references(components))
+
+    # the fields are already laid out in the packet as they would be in the buffer
+    if len(groups) == 1:
+        h, fs = groups[0]
+        w = '+'.join([width(h, f) for f in fs])
+        return 'uint8_t* buffer{0} = field_desc(pd, {1}).byte_addr;\nint buffer{0}_size = ({2}+7)/8;\n'.format(expr.id, fldid(h, fs[0]), w)
+
+    for h, fs in groups:
         w = '+'.join([width(h, f) for f in fs])
         s += 'memcpy(buffer%s + (%s+7)/8, field_desc(pd, %s).byte_addr, (%s+7)/8);\n' % (expr.id, o, fldid(h, fs[0]), w)
         o += '+'+w
     return 'int buffer{0}_size = ({1}+7)/8;\nuint8_t buffer{0}[buffer{0}_size];\n'.format(expr.id, o) + s
 
+def is_vw_field(f):
+    return f.get_attr('is_vw') is True
+
+# The byte width of a span of header fields,
+# which may end in the variable width field at the end of the header (as the options of IPv4 and TCP do).
+def span_bytewidth(hdr, span):
+    fs = hdr.type.type_ref.fields.vec
+    start = span[0].offset
+    if any(is_vw_field(f) for f in span[:-1]):
+        return None
+    if is_vw_field(span[-1]):
+        return '(pd->headers[{}].length - {})'.format(hdr.id, start / 8) if span[-1] == fs[-1] else None
+    end = span[-1].offset + span[-1].size
+    return str((end - start) / 8) if end % 8 == 0 else None
+
+# The consecutive fields of the header around the 16 bit checksum field, if the checksum word is aligned in them.
+def checksum_span(hdr, flds, cfld):
+    fs = hdr.type.type_ref.fields.vec
+    idxs = [fs.index(f) for f in flds]
+    span_idxs = sorted(idxs + [fs.index(cfld)])
+    if idxs != sorted(idxs) or span_idxs != range(span_idxs[0], span_idxs[-1] + 1):
+        return None
+
+    span = fs[span_idxs[0]:span_idxs[-1] + 1]
+    if span[0].offset % 8 != 0 or (cfld.offset - span[0].offset) % 16 != 0:
+        return None
+    return span
+
+# The bit width of a value that is summed up on its own: a field or a constant of at most 32 bits.
+def checksum_value_width(c):
+    if hasattr(c, 'field_ref'):
+        return c.field_ref.size if not is_vw_field(c.field_ref) and c.field_ref.size <= 32 else None
+    if c.node_type == 'Constant' and c.type.node_type == 'Type_Bits' and c.type.size <= 32:
+        return c.type.size
+    return None
+
+def checksum_plan(e):
+    """The data of a checksum extern is summed up without copying it
+    if it ends with the consecutive fields of a header around its 16 bit checksum field (as in IPv4, TCP and UDP)
+    and the values before them (e.g. the TCP/UDP pseudo header) are fields or constants of at most 32 bits
+    that make up whole 16 bit words.
+    Returns the values as (expression, end bit offset in the data) pairs, the header and its span,
+    the byte width of the span, and the changed fields (see checksum_changes), or None."""
+    data, cksum = e.arguments[1].expression, e.arguments[2].expression
+    if data.node_type != 'ListExpression' or not hasattr(cksum, 'field_ref') or cksum.field_ref.size != 16:
+        return None
+
+    hdr, cfld = cksum.expr.header_ref, cksum.field_ref
+    comps = list(data.components)
+    first = len(comps)
+    while first > 0 and hasattr(comps[first - 1], 'field_ref') and comps[first - 1].expr.header_ref == hdr:
+        first -= 1
+
+    # the span is as long as possible
+    spans = [(idx, checksum_span(hdr, [c.field_ref for c in comps[idx:]], cfld)) for idx in range(first, len(comps))]
+    spans = [(idx, span) for idx, span in spans if span is not None and span_bytewidth(hdr, span) is not None]
+    if spans == []:
+        return None
+
+    idx, span = spans[0]
+    widths = map(checksum_value_width, comps[:idx])
+    if None in widths or sum(widths) % 16 != 0:
+        return None
+
+    values = [(c, sum(widths[:i + 1])) for i, c in enumerate(comps[:idx])]
+    return (values, hdr, span, span_bytewidth(hdr, span), checksum_changes(e, values, hdr, span))
+
+def checksum_changes(e, values, hdr, span):
+    """If the call is marked with the fields that the program writes (see mark_checksum_updates in transform_hlir16.py),
+    the changed fields can be folded into the current checksum (RFC 1624)
+    with the values they had at parsing, which the parser extracts into pd->fields.
+    Returns the changed fields as (header, field, end bit offset in the data) triples, or None."""
+    written = e.get_attr('written_fields')
+    if written is None or e.arguments[3].expression.get_attr('member') != 'csum16':
+        return None
+
+    cfld = e.arguments[2].expression.field_ref
+    value_bits = values[-1][1] if values != [] else 0
+    flds = [(c.expr.header_ref, c.field_ref, end) for c, end in values if hasattr(c, 'field_ref')]
+    flds += [(hdr, f, None if is_vw_field(f) else value_bits + f.offset + f.size - span[0].offset) for f in span if f != cfld]
+
+    # the parser extracts the fields of fixed width packet headers only
+    hdrs = [h for h, f, end in flds] + [hdr]
+    if any(h.name in e.written_headers or h.type.type_ref.get_attr('is_metadata') or h.type.type_ref.get_attr('is_vw') for h in hdrs):
+        return None
+    if (hdr.name, cfld.name) in written:
+        return None
+
+    changes = [(h, f, end) for h, f, end in flds if (h.name, f.name) in written]
+    if any(end is None or f.size > 32 for h, f, end in changes):
+        return None
+    return changes
+
 ################################################################################
 
 def gen_method_isValid(e):
     if hasattr(e.method.expr, 'header_ref'):
-        return "(pd->headers[%s].pointer != NULL)" % e.method.expr.header_ref.id
+        return "is_header_valid(pd, %s)" % e.method.expr.header_ref.id
     else:
-        return "(pd->headers[%s].pointer != NULL)" % format_expr(e.method.expr)
+        return "is_header_valid(pd, %s)" % format_expr(e.method.expr)
 
 def gen_method_setInvalid(e):
     if hasattr(e.method.expr, 'header_ref'):
-        return "pd->headers[%s].pointer = NULL" % e.method.expr.header_ref.id
+        return "set_header_invalid(pd, %s)" % e.method.expr.header_ref.id
     else:
-        return "pd->headers[%s].pointer = NULL" % format_expr(e.method.expr)
+        return "set_header_invalid(pd, %s)" % format_expr(e.method.expr)
 
 def gen_method_apply(e):
     #[ ${e.method.expr.path.name}_apply(STDPARAMS_IN)
@@ -740,6 +901,29 @@ def gen_method_setValid(e):
     #[     /*TODO determine and set this field*/
     #[     .var_width_field_bitwidth = 0,
     #[ };
+    #[ set_header_valid(pd, ${h.id});
+
+# Returns the (header instance, field) names if the field access reads
+# the preparsed copy of the field in pd->fields instead of the packet (see gen_format_expr).
+def preparsed_field_access(e):
+    if e.get_attr('node_type') != 'Member' or hasattr(e, 'field_ref'):
+        return None
+    if hasattr(e, 'header_ref'):
+        return (e.expr.member, e.member) if e.header_ref.name == 'metadata' else None
+    if e.expr.node_type == 'PathExpression' or e.type.node_type in {'Type_Enum', 'Type_Error'}:
+        return None
+    if e.expr('expr', lambda e2: e2.type.name == 'parsed_packet'):
+        return (e.expr.member, e.member)
+    return None
+
+# The fields that have to be extracted into pd->fields by the parser:
+# the ones that the program accesses there,
+# and the ones whose changes are folded into a checksum (see checksum_changes), which need their parsed values.
+def preparsed_fields_in_use(hlir16):
+    nodes = reachable_nodes(hlir16.objects)
+    plans = [checksum_plan(n) for n in nodes if n.get_attr('written_fields') is not None]
+    changed = {(h.name, f.name) for plan in plans if plan is not None and plan[4] is not None for h, f, end in plan[4]}
+    return {acc for acc in map(preparsed_field_access, nodes) if acc is not None} | changed
 
 def print_with_base(number, base):
     if base == 16:
@@ -749,6 +933,37 @@ def print_with_base(number, base):
 
     return "{}".format(number)
 
+def is_uint64_type(t):
+    return t.node_type == 'Type_Bits' and not t.isSigned and 32 < t.size <= 64
+
+# Formats an expression of type bit<33> to bit<64> as a uint64_t value,
+# or returns None if some part of it is only available as a byte buffer.
+def format_expr_uint64(e):
+    ops = {'Add':'+', 'Sub':'-', 'Mul':'*', 'BAnd':'&', 'BOr':'|', 'BXor':'^'}
+    # the saturating operations and the shifts by a possibly too large amount are calculated by functions
+    funs = {'AddSat':'add_sat_uint64({}, {}, {})', 'SubSat':'sub_sat_uint64({}, {})', 'Shl':'shl_uint64({}, {})', 'Shr':'shr_uint64({}, {})'}
+    mask = 'UINT64_BITS_MASK({})'.format(e.type.size) if e.type.node_type == 'Type_Bits' else None
+
+    if e.node_type == 'Constant':
+        return 'UINT64_C(0x{:x})'.format(e.value)
+    if e.node_type == 'Member' and hasattr(e, 'field_ref'):
+        layout = fixed_field_layout64(member_header_type(e), e.field_ref)
+        return None if layout is None else 'GET_INT64_FIXED_PACKET(pd, {}, {})'.format(e.expr.header_ref.id, layout)
+    if e.node_type == 'Cast' and e.expr.type.node_type == 'Type_Bits' and e.expr.type.size <= 32:
+        return '((uint64_t){})'.format(format_expr(e.expr))
+    if e.node_type == 'Cmpl' and is_uint64_type(e.type):
+        value = format_expr_uint64(e.expr)
+        return None if value is None else '({} & ~{})'.format(mask, value)
+    if (e.node_type in ops or e.node_type in funs) and is_uint64_type(e.type):
+        left = format_expr_uint64(e.left)
+        right = format_expr_uint64(e.right) if e.node_type not in {'Shl', 'Shr'} else '(uint64_t)({})'.format(format_expr(e.right))
+        if left is None or right is None:
+            return None
+        if e.node_type in funs:
+            return '({} & {})'.format(mask, funs[e.node_type].format(left, right, e.type.size))
+        return '({} & ({} {} {}))'.format(mask, left, ops[e.node_type], right)
+    return None
+
 def gen_format_expr(e, format_as_value=True, expand_parameters=False):
     simple_binary_ops = {'Div':'/', 'Mod':'%',                                 #Binary arithmetic operators
                          'Grt':'>', 'Geq':'>=', 'Lss':'<', 'Leq':'<=',         #Binary comparison operators
@@ -803,6 +1018,10 @@ def gen_format_expr(e, format_as_value=True, expand_parameters=False):
     elif e.node_type == 'LNot':
         return '(!' + format_expr(e.expr) + ')'
 
+    elif e.node_type in simple_binary_ops and e.left.type.node_type == 'Type_Bits' and is_uint64_type(e.left.type) \
+            and format_expr_uint64(e.left) is not None and format_expr_uint64(e.right) is not None:
+        return '(' + format_expr_uint64(e.left) + simple_binary_ops[e.node_type] + format_expr_uint64(e.right) + ')'
+
     elif e.node_type in simple_binary_ops and e.node_type == 'Equ' and e.left.type.size > 32:
         return "0 == memcmp({}, {}, ({} + 7) / 8)".format(format_expr(e.left), format_expr(e.right), e.left.type.size)
 
@@ -833,6 +1052,9 @@ def gen_format_expr(e, format_as_value=True, expand_parameters=False):
     elif e.node_type == 'Mux':
         return '(' + format_expr(e.e0) + '?' + format_expr(e.e1) + ':' + format_expr(e.e2) + ')'
 
+    elif e.node_type == 'Slice' and e.type.size <= 32 and is_uint64_type(e.e0.type) and format_expr_uint64(e.e0) is not None:
+        return '((' + format_type(e.type) + ')(' + format_type_mask(e.type) + '(' + format_expr_uint64(e.e0) + '>>' + format_expr(e.e2) + ')))'
+
     elif e.node_type == 'Slice':
         return '(' + format_type_mask(e.type) + '(' + format_expr(e.e0) + '>>' + format_expr(e.e2) + '))'
 
@@ -913,7 +1135,7 @@ def gen_format_expr(e, format_as_value=True, expand_parameters=False):
                 else:
                     addError('formatting a select case', 'Select statement cases of type %s on %s is not supported!'
                              % (case_type, pp_type_16(k.type)))
-            cases.append('if({0}){{parser_state_{1}(pd, buf, tables, pstate);}}'.format(' && '.join(conds), format_expr(case.state)))
+            cases.append('if({0}){{goto parser_state_{1};}}'.format(' && '.join(conds), format_expr(case.state)))
         return '\nelse\n'.join(cases)
 
     elif e.node_type == 'PathExpression':
@@ -947,6 +1169,10 @@ def gen_format_expr(e, format_as_value=True, expand_parameters=False):
             else:
                 print(e.expr.header_ref.xdir())
                 hdrinst = 'header_instance_all_metadatas' if e.expr.header_ref.type_ref.is_metadata else e.expr.header_ref.id
+
+            layout = fixed_field_layout(member_header_type(e), e.field_ref)
+            if layout is not None:
+                return '(GET_INT32_FIXED_PACKET(pd, {}, {}))'.format(hdrinst, layout)
             return '(GET_INT32_AUTO_PACKET(pd, {}, {}))'.format(hdrinst, e.field_ref.id)
         elif hasattr(e, 'header_ref'):
             # TODO do both individual meta fields and metadata instance fields
@@ -1044,6 +1270,11 @@ def gen_format_expr(e, format_as_value=True, expand_parameters=False):
 
 
 def gen_format_call_extern(e, mref, method_params):
+    if mref.name in checksum_externs:
+        plan = checksum_plan(e)
+        if plan is not None:
+            return gen_format_call_checksum_inplace(e, mref, plan)
+
     fmt_params = format_method_parameters(e.arguments, method_params)
     all_params = ", ".join([p for p in [fmt_params, "SHORT_STDPARAMS_IN"] if p != ''])
 
@@ -1053,6 +1284,35 @@ def gen_format_call_extern(e, mref, method_params):
 
     #[ ${mref.name}($all_params)
 
+# The values are given as a compound literal array of csum16_value_t, see dpdk_primitives.h.
+def format_csum16_values(values):
+    def format_value((value, fld, end)):
+        inits = [('value', value), ('field', fld), ('shift', (16 - end % 16) % 16)]
+        return '{{ {} }}'.format(', '.join(['.{} = {}'.format(name, init) for name, init in inits if init is not None]))
+
+    if values == []:
+        return 'NULL'
+    return '(csum16_value_t[]) {{ {} }}'.format(', '.join(map(format_value, values)))
+
+def format_csum16_field(h, f):
+    return 'handle(header_desc_ins(pd, {}), {})'.format(h.id, f.id)
+
+def gen_format_call_checksum_inplace(e, mref, (values, hdr, span, bytewidth, changes)):
+    cond, cksum, algo = [format_method_parameter(e.arguments[idx]) for idx in [0, 2, 3]]
+    span = '(struct uint8_buffer_s) { .buffer = field_desc(pd, %s).byte_addr, .buffer_size = %s }' % (fldid(hdr, span[0]), bytewidth)
+
+    if changes is not None:
+        changes = [('pd->fields.{}'.format(fldid(h, f)), format_csum16_field(h, f), end) for h, f, end in changes]
+
+        #pre[ extern void update_checksum_incremental(bool cond, struct uint8_buffer_s span, const csum16_value_t* changes, int change_count, bitfield_handle_t cksum_field_handle, SHORT_STDPARAMS);
+        #[ update_checksum_incremental($cond, $span, ${format_csum16_values(changes)}, ${len(changes)}, $cksum, SHORT_STDPARAMS_IN)
+        return
+
+    values = [('0x{:x}'.format(c.value), None, end) if c.node_type == 'Constant' else (None, format_csum16_field(c.expr.header_ref, c.field_ref), end) for c, end in values]
+
+    #pre[ extern void ${mref.name}_inplace(bool cond, const csum16_value_t* values, int value_count, struct uint8_buffer_s span, bitfield_handle_t cksum_field_handle, int algorithm, SHORT_STDPARAMS);
+    #[ ${mref.name}_inplace($cond, ${format_csum16_values(values)}, ${len(values)}, $span, $cksum, $algo, SHORT_STDPARAMS_IN)
+
 def gen_format_call_digest(e):
     #pre[ #ifdef T4P4S_NO_CONTROL_PLANE
     #pre[ #error "Generating digest when T4P4S_NO_CONTROL_PLANE is defined"